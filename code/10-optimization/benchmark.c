@@ -0,0 +1,89 @@
+/* Measure CPE of every combiner for one data type and operation */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vec.h"
+#include "combine.h"
+#include "cpe.h"
+
+#define XSTR(x) STR(x)
+#define STR(x) #x
+
+/* Default largest vector: half of a 32KB L1, whatever the data type.
+   Longer vectors keep the fastest combiners' times well above the
+   timing noise */
+#define MAXN (16384 / (long) sizeof(data_t))
+
+static vec *v;
+static combiner cur;
+static data_t result;
+
+static void run_combiner(long n)
+{
+    set_vec_length(v, n);
+    cur(v, &result);
+}
+
+/* Values whose sum and product are exact in every data type, so all
+   combiners must agree whatever order they combine in */
+static void init_vec(vec *v, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+#ifdef PROD
+	set_vec_element(v, i, i % 5 == 0 ? -1 : 1);
+#else
+	set_vec_element(v, i, i % 8);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    long maxn = MAXN;
+    data_t check;
+    double cpe, icpt, r2;
+    int i, poor = 0;
+
+    if (argc > 1)
+	maxn = atol(argv[1]);
+    if (maxn < 20) {
+	fprintf(stderr, "Usage: %s [maxn >= 20]\n", argv[0]);
+	exit(1);
+    }
+    v = new_vec(maxn);
+    if (!v) {
+	fprintf(stderr, "Couldn't allocate vector of %ld elements\n", maxn);
+	exit(1);
+    }
+    init_vec(v, maxn);
+    combiners[0].f(v, &check);
+
+    printf("data_t = %s, OP = %s, n = %ld..%ld\n",
+	   XSTR(DATA_T), OPNAME, maxn / 20, maxn);
+    printf("%-12s%8s%10s%8s  %s\n", "Function", "CPE", "Overhead", "R^2",
+	   "Description");
+    for (i = 0; combiners[i].f; i++) {
+	if (combiners[i].avx2 && !__builtin_cpu_supports("avx2")) {
+	    printf("%-12s%8s%10s%8s  %s\n", combiners[i].name, "-", "-", "-",
+		   "(needs AVX2)");
+	    continue;
+	}
+	cur = combiners[i].f;
+	set_vec_length(v, maxn);
+	cur(v, &result);
+	if (result != check)
+	    printf("Warning: %s result differs from combine1\n",
+		   combiners[i].name);
+	cpe = find_cpe_full(run_combiner, maxn, 20, &icpt, &r2);
+	printf("%-12s%8.2f%10.1f%8.4f%c %s\n", combiners[i].name, cpe, icpt, r2,
+	       r2 < CPE_MIN_R2 ? '?' : ' ', combiners[i].descr);
+	if (r2 < CPE_MIN_R2)
+	    poor = 1;
+    }
+    if (poor)
+	printf("? R^2 below %.2f after %d fits: CPE unreliable, try a larger maxn\n",
+	       CPE_MIN_R2, CPE_TRIES);
+    free_vec(v);
+    return 0;
+}
@@ -0,0 +1,349 @@
+/* The combine progression: the same reduction, successively optimized */
+#include <stdlib.h>
+#include "vec.h"
+#include "combine.h"
+
+/* Implementation with maximum use of data abstraction */
+void combine1(vec *v, data_t *dest)
+{
+    long i;
+
+    *dest = IDENT;
+    for (i = 0; i < vec_length(v); i++) {
+	data_t val;
+	get_vec_element(v, i, &val);
+	*dest = *dest OP val;
+    }
+}
+
+/* Move call to vec_length out of loop */
+void combine2(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+
+    *dest = IDENT;
+    for (i = 0; i < length; i++) {
+	data_t val;
+	get_vec_element(v, i, &val);
+	*dest = *dest OP val;
+    }
+}
+
+/* Direct access to vector data */
+void combine3(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    data_t *data = get_vec_start(v);
+
+    *dest = IDENT;
+    for (i = 0; i < length; i++) {
+	*dest = *dest OP data[i];
+    }
+}
+
+/* Accumulate result in local variable */
+void combine4(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    for (i = 0; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/* 2 x 1 loop unrolling */
+void combine5(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-1;
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    /* Combine 2 elements at a time */
+    for (i = 0; i < limit; i+=2) {
+	acc = (acc OP data[i]) OP data[i+1];
+    }
+
+    /* Finish any remaining elements */
+    for (; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/* 4 x 1 loop unrolling */
+void unroll4x1(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-3;
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    for (i = 0; i < limit; i+=4) {
+	acc = (((acc OP data[i]) OP data[i+1]) OP data[i+2]) OP data[i+3];
+    }
+    for (; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/* 2 x 2 loop unrolling */
+void combine6(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-1;
+    data_t *data = get_vec_start(v);
+    data_t acc0 = IDENT;
+    data_t acc1 = IDENT;
+
+    /* Combine 2 elements at a time */
+    for (i = 0; i < limit; i+=2) {
+	acc0 = acc0 OP data[i];
+	acc1 = acc1 OP data[i+1];
+    }
+
+    /* Finish any remaining elements */
+    for (; i < length; i++) {
+	acc0 = acc0 OP data[i];
+    }
+    *dest = acc0 OP acc1;
+}
+
+/* 4 x 4 loop unrolling */
+void unroll4x4(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-3;
+    data_t *data = get_vec_start(v);
+    data_t acc0 = IDENT;
+    data_t acc1 = IDENT;
+    data_t acc2 = IDENT;
+    data_t acc3 = IDENT;
+
+    for (i = 0; i < limit; i+=4) {
+	acc0 = acc0 OP data[i];
+	acc1 = acc1 OP data[i+1];
+	acc2 = acc2 OP data[i+2];
+	acc3 = acc3 OP data[i+3];
+    }
+    for (; i < length; i++) {
+	acc0 = acc0 OP data[i];
+    }
+    *dest = (acc0 OP acc1) OP (acc2 OP acc3);
+}
+
+/* 8 x 8 loop unrolling */
+void unroll8x8(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-7;
+    data_t *data = get_vec_start(v);
+    data_t acc0 = IDENT;
+    data_t acc1 = IDENT;
+    data_t acc2 = IDENT;
+    data_t acc3 = IDENT;
+    data_t acc4 = IDENT;
+    data_t acc5 = IDENT;
+    data_t acc6 = IDENT;
+    data_t acc7 = IDENT;
+
+    for (i = 0; i < limit; i+=8) {
+	acc0 = acc0 OP data[i];
+	acc1 = acc1 OP data[i+1];
+	acc2 = acc2 OP data[i+2];
+	acc3 = acc3 OP data[i+3];
+	acc4 = acc4 OP data[i+4];
+	acc5 = acc5 OP data[i+5];
+	acc6 = acc6 OP data[i+6];
+	acc7 = acc7 OP data[i+7];
+    }
+    for (; i < length; i++) {
+	acc0 = acc0 OP data[i];
+    }
+    *dest = ((acc0 OP acc1) OP (acc2 OP acc3)) OP
+	((acc4 OP acc5) OP (acc6 OP acc7));
+}
+
+/* 2 x 1a loop unrolling: reassociate the combining */
+void combine7(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-1;
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    /* Combine 2 elements at a time */
+    for (i = 0; i < limit; i+=2) {
+	acc = acc OP (data[i] OP data[i+1]);
+    }
+
+    /* Finish any remaining elements */
+    for (; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/* 4 x 1a loop unrolling */
+void unroll4x1a(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-3;
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    for (i = 0; i < limit; i+=4) {
+	acc = acc OP ((data[i] OP data[i+1]) OP (data[i+2] OP data[i+3]));
+    }
+    for (; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/* 8 x 1a loop unrolling */
+void unroll8x1a(vec *v, data_t *dest)
+{
+    long i;
+    long length = vec_length(v);
+    long limit = length-7;
+    data_t *data = get_vec_start(v);
+    data_t acc = IDENT;
+
+    for (i = 0; i < limit; i+=8) {
+	data_t t0 = (data[i] OP data[i+1]) OP (data[i+2] OP data[i+3]);
+	data_t t1 = (data[i+4] OP data[i+5]) OP (data[i+6] OP data[i+7]);
+	acc = acc OP (t0 OP t1);
+    }
+    for (; i < length; i++) {
+	acc = acc OP data[i];
+    }
+    *dest = acc;
+}
+
+/*
+ * Vector versions, using GCC's vector extensions.  A vec_t holds
+ * VSIZE elements, and OP applies to all of them at once.  Scalar
+ * steps bring data to a VBYTES boundary, so that vector loads are
+ * aligned.  Compiled for AVX2; benchmark checks the CPU first.
+ */
+#define VBYTES 32
+#define VSIZE (VBYTES/sizeof(data_t))
+
+typedef data_t vec_t __attribute__ ((vector_size(VBYTES)));
+
+/* One vector accumulator */
+__attribute__((target("avx2")))
+void simd_v1(vec *v, data_t *dest)
+{
+    long i;
+    long cnt = vec_length(v);
+    data_t *data = get_vec_start(v);
+    vec_t accum;
+    data_t result = IDENT;
+
+    for (i = 0; i < VSIZE; i++)
+	accum[i] = IDENT;
+
+    /* Single step until aligned */
+    while ((((size_t) data) % VBYTES) != 0 && cnt) {
+	result = result OP *data++;
+	cnt--;
+    }
+
+    /* Step through data with VSIZE-way parallelism */
+    while (cnt >= VSIZE) {
+	vec_t chunk = *((vec_t *) data);
+	accum = accum OP chunk;
+	data += VSIZE;
+	cnt -= VSIZE;
+    }
+
+    /* Single-step through remaining elements */
+    while (cnt) {
+	result = result OP *data++;
+	cnt--;
+    }
+
+    /* Combine elements of accumulator vector */
+    for (i = 0; i < VSIZE; i++)
+	result = result OP accum[i];
+    *dest = result;
+}
+
+/* Four vector accumulators: 4*VSIZE-way parallelism */
+__attribute__((target("avx2")))
+void simd_v4(vec *v, data_t *dest)
+{
+    long i;
+    long cnt = vec_length(v);
+    data_t *data = get_vec_start(v);
+    vec_t accum0, accum1, accum2, accum3;
+    data_t result = IDENT;
+
+    for (i = 0; i < VSIZE; i++)
+	accum0[i] = IDENT;
+    accum1 = accum0;
+    accum2 = accum0;
+    accum3 = accum0;
+
+    while ((((size_t) data) % VBYTES) != 0 && cnt) {
+	result = result OP *data++;
+	cnt--;
+    }
+
+    while (cnt >= 4*VSIZE) {
+	vec_t chunk0 = *((vec_t *) data);
+	vec_t chunk1 = *((vec_t *) (data+VSIZE));
+	vec_t chunk2 = *((vec_t *) (data+2*VSIZE));
+	vec_t chunk3 = *((vec_t *) (data+3*VSIZE));
+	accum0 = accum0 OP chunk0;
+	accum1 = accum1 OP chunk1;
+	accum2 = accum2 OP chunk2;
+	accum3 = accum3 OP chunk3;
+	data += 4*VSIZE;
+	cnt -= 4*VSIZE;
+    }
+
+    while (cnt) {
+	result = result OP *data++;
+	cnt--;
+    }
+
+    accum0 = (accum0 OP accum1) OP (accum2 OP accum3);
+    for (i = 0; i < VSIZE; i++)
+	result = result OP accum0[i];
+    *dest = result;
+}
+
+combiner_info combiners[] = {
+    {combine1, "combine1", "Abstract, vec_length in loop test", 0},
+    {combine2, "combine2", "Move vec_length", 0},
+    {combine3, "combine3", "Direct data access", 0},
+    {combine4, "combine4", "Accumulate in temporary", 0},
+    {combine5, "combine5", "Unroll 2 x 1", 0},
+    {unroll4x1, "unroll4x1", "Unroll 4 x 1", 0},
+    {combine6, "combine6", "Unroll 2 x 2", 0},
+    {unroll4x4, "unroll4x4", "Unroll 4 x 4", 0},
+    {unroll8x8, "unroll8x8", "Unroll 8 x 8", 0},
+    {combine7, "combine7", "Unroll 2 x 1a", 0},
+    {unroll4x1a, "unroll4x1a", "Unroll 4 x 1a", 0},
+    {unroll8x1a, "unroll8x1a", "Unroll 8 x 1a", 0},
+    {simd_v1, "simd_v1", "Vector, 1 accumulator", 1},
+    {simd_v4, "simd_v4", "Vector, 4 accumulators", 1},
+    {NULL, NULL, NULL, 0}
+};
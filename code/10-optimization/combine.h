@@ -0,0 +1,29 @@
+/* Combining functions over the vec ADT */
+
+/*
+ * Each combiner sets *dest to the combination of all elements of v
+ * under OP, starting from IDENT.  The element type comes from vec.h
+ * (-DDATA_T=...), and the operation is sum, or product when compiled
+ * with -DPROD.
+ */
+#ifdef PROD
+#define IDENT 1
+#define OP *
+#define OPNAME "*"
+#else
+#define IDENT 0
+#define OP +
+#define OPNAME "+"
+#endif
+
+typedef void (*combiner)(vec *v, data_t *dest);
+
+typedef struct {
+    combiner f;
+    char *name;
+    char *descr;
+    int avx2;      /* Needs AVX2 */
+} combiner_info;
+
+/* All combiners, in order of the text.  Ends with f == NULL */
+extern combiner_info combiners[];
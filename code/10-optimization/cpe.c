@@ -0,0 +1,86 @@
+/* Compute CPE by timing a function over a range of n and fitting a line */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clock.h"
+#include "bench.h"
+#include "cpe.h"
+
+typedef struct {
+    elem_fun_t f;
+    long n;
+} cpe_arg_t;
+
+static void cpe_run(void *vargp)
+{
+    cpe_arg_t *a = (cpe_arg_t *) vargp;
+    a->f(a->n);
+}
+
+/* Minimum cycles for f(n), with the data warm in cache */
+static double measure(elem_fun_t f, long n)
+{
+    cpe_arg_t arg = {f, n};
+    bench_closure_t b = {cpe_run, cpe_run, NULL, &arg};
+    bench_params_t p = {3, 0.01, 100, 1, BENCH_FLUSH_NONE, BENCH_CLOCK_CORE};
+    bench_result_t r;
+
+    bench_run(&b, &p, &r);
+    bench_free(&r);
+    return r.min;
+}
+
+/* One least squares fit.  Returns the slope */
+static double fit(elem_fun_t f, long maxn, int npoints,
+		  double *intercept, double *r2)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    double slope, icpt, x, y, res = 0;
+    double *ys = malloc(npoints * sizeof(double));
+    int i;
+
+    for (i = 0; i < npoints; i++) {
+	x = (double) maxn * (i+1) / npoints;
+	y = ys[i] = measure(f, (long) x);
+	sx += x; sy += y;
+	sxx += x*x; sxy += x*y; syy += y*y;
+    }
+    slope = (npoints*sxy - sx*sy) / (npoints*sxx - sx*sx);
+    icpt = (sy - slope*sx) / npoints;
+    for (i = 0; i < npoints; i++) {
+	x = (double) maxn * (i+1) / npoints;
+	y = ys[i] - (icpt + slope*x);
+	res += y*y;
+    }
+    free(ys);
+    *intercept = icpt;
+    *r2 = syy - sy*sy/npoints > 0 ? 1 - res / (syy - sy*sy/npoints) : 1;
+    return slope;
+}
+
+double find_cpe_full(elem_fun_t f, long maxn, int npoints,
+		     double *intercept, double *r2)
+{
+    double slope = 0, icpt = 0, best = -1;
+    int t;
+
+    for (t = 0; t < CPE_TRIES && best < CPE_MIN_R2; t++) {
+	double s, i, r;
+	s = fit(f, maxn, npoints, &i, &r);
+	if (r > best) {
+	    slope = s;
+	    icpt = i;
+	    best = r;
+	}
+    }
+    if (intercept)
+	*intercept = icpt;
+    if (r2)
+	*r2 = best;
+    return slope;
+}
+
+double find_cpe(elem_fun_t f, long maxn)
+{
+    return find_cpe_full(f, maxn, 20, NULL, NULL);
+}
@@ -0,0 +1,23 @@
+/* Compute cycles per element (CPE) for a function on n elements */
+
+/* Function to be measured: process n elements */
+typedef void (*elem_fun_t)(long n);
+
+/* A fit with R^2 below this is measured again */
+#define CPE_MIN_R2 0.99
+/* Most fits made for one function */
+#define CPE_TRIES 5
+
+/*
+ * Time f for npoints values of n evenly spaced up to maxn, then fit
+ * cycles = intercept + CPE * n by least squares.  Cycles are core
+ * cycles where perf_event_open allows, else TSC cycles.  Repeats the
+ * whole fit while R^2 < CPE_MIN_R2, up to CPE_TRIES times, and keeps
+ * the best.  Returns the CPE.  If intercept or r2 (coefficient of
+ * determination of the fit) are not NULL, they are set too.
+ */
+double find_cpe_full(elem_fun_t f, long maxn, int npoints,
+		     double *intercept, double *r2);
+
+/* Same, with 20 points */
+double find_cpe(elem_fun_t f, long maxn);
@@ -10,6 +10,7 @@ vec *new_vec(size_t len)
     if (!result)
         return NULL;  /* Couldn't allocate storage */
     result->len = len;
+    result->allocated_len = len;
     data_t *data = NULL;
     if (len > 0) {
         data = (data_t *) calloc(len, sizeof(data_t));
@@ -66,3 +67,18 @@ int set_vec_element(vec *v, size_t index, data_t val)
     return 1;
 }
 
+
+/* Set length of vector.  If > allocated length, will reallocate.
+   Return 0 (couldn't allocate storage) or 1 (successful) */
+int set_vec_length(vec *v, size_t newlen)
+{
+    if (newlen > v->allocated_len) {
+	data_t *data = (data_t *) realloc(v->data, newlen * sizeof(data_t));
+	if (!data)
+	    return 0;
+	v->data = data;
+	v->allocated_len = newlen;
+    }
+    v->len = newlen;
+    return 1;
+}
@@ -1,10 +1,14 @@
-/* Sample data type */
-typedef double data_t;
+/* Sample data type.  Compile with -DDATA_T=long etc. to change it */
+#ifndef DATA_T
+#define DATA_T double
+#endif
+typedef DATA_T data_t;
 
 /* Create abstract data type for vector */
 typedef struct {
     size_t len;
     data_t *data;
+    size_t allocated_len;  /* Elements data has room for */
 } vec;
 
 /* Create vector */
@@ -37,5 +41,8 @@ int set_vec_element(vec *v, size_t index, data_t val);
 /* Get vector length */
 size_t vec_length(vec *v);
 
-/* Set length of vector.  If > allocated length, will reallocate */
-void set_vec_length(vec *v, size_t newlen);
+/*
+ * Set length of vector.  If > allocated length, will reallocate.
+ * Return 0 (couldn't allocate storage) or 1 (successful)
+ */
+int set_vec_length(vec *v, size_t newlen);
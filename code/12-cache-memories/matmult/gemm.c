@@ -0,0 +1,324 @@
+/* 
+ * gemm.c - GotoBLAS-style matrix multiply: packed panels, cache
+ *          blocking at three levels and a 6x8 AVX2/FMA micro-kernel.
+ *          pdgemm spreads tiles of C over a pool of threads.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <immintrin.h>
+#include "mm.h"
+#include "gemm.h"
+
+#define MR GEMM_MR
+#define NR GEMM_NR
+#define KC GEMM_KC
+#define MC GEMM_MC
+#define NC GEMM_NC
+
+/* Packed blocks.  Edge slivers are padded with zeros to full width */
+static double apack[MC*KC] __attribute__((aligned(64)));
+static double bpack[KC*NC] __attribute__((aligned(64)));
+
+/* Copy mc x kc block of A into MR-row slivers, column by column */
+static void pack_a(int mc, int kc, const double *A, int lda, double *pa)
+{
+    int i, k, r;
+
+    for (i = 0; i < mc; i += MR) {
+	int mr = min(MR, mc - i);
+	for (k = 0; k < kc; k++) {
+	    for (r = 0; r < mr; r++)
+		*pa++ = A[(i+r)*lda + k];
+	    for (; r < MR; r++)
+		*pa++ = 0.0;
+	}
+    }
+}
+
+/* Copy kc x nr slice of B into one NR-column sliver, row by row */
+static void pack_b_sliver(int kc, int nr, const double *B, int ldb, double *pb)
+{
+    int k, c;
+
+    for (k = 0; k < kc; k++) {
+	const double *b = B + k*ldb;
+	for (c = 0; c < nr; c++)
+	    *pb++ = b[c];
+	for (; c < NR; c++)
+	    *pb++ = 0.0;
+    }
+}
+
+/* Copy kc x nc panel of B into NR-column slivers */
+static void pack_b(int kc, int nc, const double *B, int ldb, double *pb)
+{
+    int j;
+
+    for (j = 0; j < nc; j += NR)
+	pack_b_sliver(kc, min(NR, nc - j), B + j, ldb, pb + j*kc);
+}
+
+/* 
+ * C[0..MR-1][0..NR-1] += a sliver * b sliver.  The 6x8 tile of C is
+ * held in 12 ymm registers; each step of k loads two vectors of b and
+ * broadcasts six elements of a, for 12 independent FMAs.
+ */
+#define ROW(r)								\
+    ar = _mm256_broadcast_sd(a + r);					\
+    c##r##0 = _mm256_fmadd_pd(ar, b0, c##r##0);				\
+    c##r##1 = _mm256_fmadd_pd(ar, b1, c##r##1);
+
+#define STORE(r)							\
+    _mm256_storeu_pd(C + r*ldc,						\
+		     _mm256_add_pd(_mm256_loadu_pd(C + r*ldc), c##r##0));	\
+    _mm256_storeu_pd(C + r*ldc + 4,					\
+		     _mm256_add_pd(_mm256_loadu_pd(C + r*ldc + 4), c##r##1));
+
+__attribute__((target("avx2,fma")))
+static void kernel_avx2(int kc, const double *a, const double *b,
+			double *C, int ldc)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = c00, c10 = c00, c11 = c00;
+    __m256d c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+    __m256d c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+    __m256d ar, b0, b1;
+    int k;
+
+    for (k = 0; k < kc; k++) {
+	b0 = _mm256_load_pd(b);
+	b1 = _mm256_load_pd(b + 4);
+	ROW(0) ROW(1) ROW(2) ROW(3) ROW(4) ROW(5)
+	a += MR;
+	b += NR;
+    }
+    STORE(0) STORE(1) STORE(2) STORE(3) STORE(4) STORE(5)
+}
+
+/* Portable version of the micro-kernel */
+static void kernel_scalar(int kc, const double *a, const double *b,
+			  double *C, int ldc)
+{
+    double c[MR][NR] = {{0}};
+    int i, j, k;
+
+    for (k = 0; k < kc; k++, a += MR, b += NR)
+	for (i = 0; i < MR; i++)
+	    for (j = 0; j < NR; j++)
+		c[i][j] += a[i] * b[j];
+    for (i = 0; i < MR; i++)
+	for (j = 0; j < NR; j++)
+	    C[i*ldc + j] += c[i][j];
+}
+
+typedef void (*kernel_t)(int, const double *, const double *, double *, int);
+static kernel_t kernel = NULL;
+
+/* Multiply packed block pa by packed slivers pb into mc x nc block of C */
+static void macro_kernel(int mc, int nc, int kc, const double *pa,
+			 const double *pb, double *C, int ldc)
+{
+    double tmp[MR*NR];
+    int ir, jr, i, j;
+
+    for (jr = 0; jr < nc; jr += NR) {
+	int nr = min(NR, nc - jr);
+	for (ir = 0; ir < mc; ir += MR) {
+	    int mr = min(MR, mc - ir);
+	    const double *a = pa + ir*kc;
+	    const double *b = pb + jr*kc;
+	    double *c = C + ir*ldc + jr;
+	    if (mr == MR && nr == NR) {
+		kernel(kc, a, b, c, ldc);
+	    } else {
+		/* Edge tile: compute in full, add back the valid part */
+		memset(tmp, 0, sizeof(tmp));
+		kernel(kc, a, b, tmp, NR);
+		for (i = 0; i < mr; i++)
+		    for (j = 0; j < nr; j++)
+			c[i*ldc + j] += tmp[i*NR + j];
+	    }
+	}
+    }
+}
+
+static void select_kernel()
+{
+    if (!kernel)
+	kernel = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+	    ? kernel_avx2 : kernel_scalar;
+}
+
+void dgemm(int m, int n, int k,
+	   const double *A, int lda, const double *B, int ldb,
+	   double *C, int ldc)
+{
+    int jc, pc, ic;
+
+    select_kernel();
+    for (jc = 0; jc < n; jc += NC) {
+	int nc = min(NC, n - jc);
+	for (pc = 0; pc < k; pc += KC) {
+	    int kc = min(KC, k - pc);
+	    pack_b(kc, nc, B + pc*ldb + jc, ldb, bpack);
+	    for (ic = 0; ic < m; ic += MC) {
+		int mc = min(MC, m - ic);
+		pack_a(mc, kc, A + ic*lda + pc, lda, apack);
+		macro_kernel(mc, nc, kc, apack, bpack, C + ic*ldc + jc, ldc);
+	    }
+	}
+    }
+}
+
+void gemm(array A, array B, array C, int n)
+{
+    int ld = sizeof(A[0]) / sizeof(double);
+    dgemm(n, n, n, &A[0][0], ld, &B[0][0], ld, &C[0][0], ld);
+}
+
+/* 
+ * Parallel version.  For each KC x NC panel of B, the threads pack
+ * the panel's slivers together into the shared buffer.  The
+ * corresponding m x nc block of C is cut into tiles of MC rows by a
+ * multiple of NR columns, with enough columns per row of tiles to
+ * give every thread work.  Threads take tiles from a shared counter,
+ * packing the A block for a tile into their own buffer unless they
+ * already hold it.  The caller is thread 0.
+ */
+#define GEMM_MAXTHREADS 256
+
+/* Current job.  Threads work from their own copy: the caller may
+   overwrite job with the next one as soon as it passes the last
+   barrier, while others are still leaving their loops */
+typedef struct {
+    int m, n, k;
+    const double *A, *B;
+    double *C;
+    int lda, ldb, ldc;
+    int nthreads;
+} gemm_job_t;
+static gemm_job_t job;
+static long job_gen = 0;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+
+static int nstarted = 1;        /* Threads created, including caller */
+static volatile int next_tile;  /* Next tile to hand out */
+
+/* Barrier for the threads of the current job */
+static volatile int bar_count = 0;
+static volatile long bar_gen = 0;
+
+static void barrier(int nt)
+{
+    long gen = __atomic_load_n(&bar_gen, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&bar_count, 1, __ATOMIC_ACQ_REL) == nt) {
+	bar_count = 0;
+	__atomic_store_n(&bar_gen, gen + 1, __ATOMIC_RELEASE);
+    } else {
+	while (__atomic_load_n(&bar_gen, __ATOMIC_ACQUIRE) == gen)
+	    sched_yield();
+    }
+}
+
+/* Thread id's part of job, packing A blocks into pa */
+static void pdgemm_share(int id, double *pa, gemm_job_t job)
+{
+    int nt = job.nthreads;
+    int jc, pc, j, t;
+
+    for (jc = 0; jc < job.n; jc += NC) {
+	int nc = min(NC, job.n - jc);
+	int nsliver = (nc + NR - 1) / NR;
+	int rows = (job.m + MC - 1) / MC;
+	/* Tile width: at least NR, narrow enough for nt tiles */
+	int cols = min(nsliver, (nt + rows - 1) / rows);
+	int width = (nsliver + cols - 1) / cols * NR;
+	cols = (nc + width - 1) / width;
+	for (pc = 0; pc < job.k; pc += KC) {
+	    int kc = min(KC, job.k - pc);
+	    int last_row = -1;
+	    for (j = id; j < nsliver; j += nt)
+		pack_b_sliver(kc, min(NR, nc - j*NR),
+			      job.B + pc*job.ldb + jc + j*NR, job.ldb,
+			      bpack + j*NR*kc);
+	    barrier(nt);
+	    while ((t = __atomic_fetch_add(&next_tile, 1, __ATOMIC_RELAXED))
+		   < rows * cols) {
+		int r = t / cols;
+		int ic = r * MC;
+		int mc = min(MC, job.m - ic);
+		int j0 = (t % cols) * width;
+		if (r != last_row) {
+		    pack_a(mc, kc, job.A + ic*job.lda + pc, job.lda, pa);
+		    last_row = r;
+		}
+		macro_kernel(mc, min(width, nc - j0), kc, pa, bpack + j0*kc,
+			     job.C + ic*job.ldc + jc + j0, job.ldc);
+	    }
+	    barrier(nt);
+	    /* Nobody takes tiles again until after the next barrier */
+	    if (id == 0)
+		next_tile = 0;
+	}
+    }
+}
+
+static void *pdgemm_thread(void *vargp)
+{
+    int id = (long) vargp;
+    double *pa = aligned_alloc(64, MC*KC*sizeof(double));
+    long gen = 0;
+
+    while (1) {
+	pthread_mutex_lock(&job_mutex);
+	while (job_gen == gen)
+	    pthread_cond_wait(&job_cond, &job_mutex);
+	gen = job_gen;
+	gemm_job_t my_job = job;
+	pthread_mutex_unlock(&job_mutex);
+	if (id < my_job.nthreads)
+	    pdgemm_share(id, pa, my_job);
+    }
+    return NULL;
+}
+
+void pdgemm(int nthreads, int m, int n, int k,
+	    const double *A, int lda, const double *B, int ldb,
+	    double *C, int ldc)
+{
+    static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t tid;
+    long i;
+
+    if (nthreads <= 0)
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > GEMM_MAXTHREADS)
+	nthreads = GEMM_MAXTHREADS;
+    if (nthreads == 1) {
+	dgemm(m, n, k, A, lda, B, ldb, C, ldc);
+	return;
+    }
+    select_kernel();
+    /* One multiply at a time: the B buffer is shared */
+    pthread_mutex_lock(&call_mutex);
+    for (i = nstarted; i < nthreads; i++) {
+	pthread_create(&tid, NULL, pdgemm_thread, (void *) i);
+	pthread_detach(tid);
+    }
+    if (nthreads > nstarted)
+	nstarted = nthreads;
+    pthread_mutex_lock(&job_mutex);
+    job.m = m; job.n = n; job.k = k;
+    job.A = A; job.B = B; job.C = C;
+    job.lda = lda; job.ldb = ldb; job.ldc = ldc;
+    job.nthreads = nthreads;
+    next_tile = 0;
+    job_gen++;
+    pthread_cond_broadcast(&job_cond);
+    pthread_mutex_unlock(&job_mutex);
+    pdgemm_share(0, apack, job);
+    pthread_mutex_unlock(&call_mutex);
+}
@@ -0,0 +1,31 @@
+/* GotoBLAS-style matrix multiply */
+
+/*
+ * C += A*B for an m x k matrix A and a k x n matrix B, all row-major
+ * with leading dimensions (row lengths) lda, ldb and ldc.
+ *
+ * B is copied a KC x NC panel at a time into a contiguous buffer meant
+ * to stay in L3, and A an MC x KC block at a time into one meant to
+ * stay in L2.  A register-blocked micro-kernel then computes MR x NR
+ * tiles of C from MR-row slivers of the A block and NR-column slivers
+ * of the B panel, each sliver streaming through L1.
+ */
+#define GEMM_MR 6
+#define GEMM_NR 8
+#define GEMM_KC 256
+#define GEMM_MC 96
+#define GEMM_NC 4080
+
+void dgemm(int m, int n, int k,
+	   const double *A, int lda, const double *B, int ldb,
+	   double *C, int ldc);
+
+/* Same, with C split into tiles shared among nthreads threads
+   (nthreads <= 0: one per online processor).  Threads persist
+   between calls */
+void pdgemm(int nthreads, int m, int n, int k,
+	    const double *A, int lda, const double *B, int ldb,
+	    double *C, int ldc);
+
+/* dgemm in the form used by the mm.c harness */
+void gemm(array A, array B, array C, int n);
@@ -4,6 +4,8 @@
 #include "mm.h"
 #include "fcycmm.h"
 #include "clock.h"
+#include "gemm.h"
+#include "recmm.h"
 
 /* whether or not fcyc should clear the cache */
 #define CLEARCACHE 1  
@@ -36,6 +38,22 @@ double run(test_funct f, int n)
     return(cpi);
 }
 
+/* Run transpose f and return clocks per element */
+double run_transpose(test_funct f, int n)
+{
+    double cpe;
+    int i, j;
+
+    cpe = fcyc(f, n, CLEARCACHE) / (n*n);
+    for (i = 0; i < n; i++)
+	for (j = 0; j < n; j++)
+	    if (gc[j][i] != ga[i][j]) {
+		printf("Error: bad transpose at (%d,%d)\n", j, i);
+		exit(0);
+	    }
+    return(cpe);
+}
+
 /* reset result array to zero */
 void reset(array c, int n)
 {
@@ -62,6 +80,16 @@ void init(array a, array b, int n)
 }
 
 
+/* Small integers, so that every product and sum is exact */
+static void init_random(array a, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++)
+	for (j = 0; j < n; j++)
+	    a[i][j] = (double) (rand() % 7 - 3);
+}
+
 /* print an array (debug) */
 void printarray(array a, int n)
 {
@@ -171,6 +199,80 @@ for (j = 0; j < n; j++)
 /* $end mm-jki */
 }
 
+/*
+ * Check every version against ijk on random small-integer inputs.
+ * The sizes are not multiples of GEMM_MR, GEMM_NR or REC_LEAF, so
+ * that the edge cases of the blocked and recursive code run.  dgemm
+ * also gets non-square shapes, including k > GEMM_KC and m > GEMM_MC
+ */
+static array gref;
+
+static void check_random()
+{
+    static int sizes[] = {1, 7, 13, 37, 61, 101, 133, 0};
+    static int shapes[][3] = {{13, 37, 61}, {101, 7, 301}, {97, 203, 259}};
+    static struct {test_funct f; char *name;} fns[] = {
+	{jki, "jki"}, {kji, "kji"}, {jik, "jik"}, {kij, "kij"},
+	{ikj, "ikj"}, {gemm, "gemm"}, {rmm, "rmm"}, {zmm, "zmm"}, {NULL, NULL}
+    };
+    static struct {test_funct f; char *name;} tfns[] = {
+	{trans, "trans"}, {rtrans, "rtrans"}, {NULL, NULL}
+    };
+    int ld = sizeof(ga[0]) / sizeof(double);
+    int s, f, i, j, n;
+
+    srand(1);
+    for (s = 0; (n = sizes[s]) != 0; s++) {
+	init_random(ga, n);
+	init_random(gb, n);
+	reset(gref, n);
+	ijk(ga, gb, gref, n);
+	for (f = 0; fns[f].f != NULL; f++) {
+	    reset(gc, n);
+	    fns[f].f(ga, gb, gc, n);
+	    for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+		    if (gc[i][j] != gref[i][j]) {
+			printf("Error: %s, n = %d: C[%d][%d] = %f, not %f\n",
+			       fns[f].name, n, i, j, gc[i][j], gref[i][j]);
+			exit(1);
+		    }
+	}
+	for (f = 0; tfns[f].f != NULL; f++) {
+	    tfns[f].f(ga, gb, gc, n);
+	    for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+		    if (gc[j][i] != ga[i][j]) {
+			printf("Error: %s, n = %d: bad transpose at (%d,%d)\n",
+			       tfns[f].name, n, j, i);
+			exit(1);
+		    }
+	}
+    }
+
+    /* Non-square dgemm, using the top-left corners of the arrays */
+    for (s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+	int m = shapes[s][0], nn = shapes[s][1], k = shapes[s][2];
+	int l;
+	init_random(ga, MAXN);
+	init_random(gb, MAXN);
+	reset(gc, MAXN);
+	dgemm(m, nn, k, &ga[0][0], ld, &gb[0][0], ld, &gc[0][0], ld);
+	for (i = 0; i < MAXN; i++)
+	    for (j = 0; j < MAXN; j++) {
+		double sum = 0.0;
+		if (i < m && j < nn)
+		    for (l = 0; l < k; l++)
+			sum += ga[i][l] * gb[l][j];
+		if (gc[i][j] != sum) {
+		    printf("Error: dgemm %dx%dx%d: C[%d][%d] = %f, not %f\n",
+			   m, nn, k, i, j, gc[i][j], sum);
+		    exit(1);
+		}
+	    }
+    }
+}
+
 /* 
  * Run the six versions of matrix multiply and display performance
  * as clock cycles per inner loop iteration.
@@ -180,11 +282,12 @@ int main()
 {
     int n;
 
+    check_random();
     init(ga, gb, MAXN);
 
     printf("matmult cycles/loop iteration\n");
-    printf("%3s%6s%6s%6s%6s%6s%6s\n", "n", 
-	   "jki", "kji", "ijk", "jik", "kij", "ikj");
+    printf("%3s%6s%6s%6s%6s%6s%6s%6s%6s%6s\n", "n", 
+	   "jki", "kji", "ijk", "jik", "kij", "ikj", "gemm", "rec", "zrec");
     fflush(stdout);
     for (n = MINN; n <= MAXN; n += INCN) {  
 	printf("%3d ", n);
@@ -195,6 +298,19 @@ int main()
 	printf("%5.2f ", run(jik, n));
 	printf("%5.2f ", run(kij, n));
 	printf("%5.2f ", run(ikj, n));
+	printf("%5.2f ", run(gemm, n));
+	printf("%5.2f ", run(rmm, n));
+	printf("%5.2f ", run(zmm, n));
+	printf("\n");
+	fflush(stdout);
+    }
+
+    printf("\ntranspose cycles/element\n");
+    printf("%3s%6s%6s\n", "n", "rows", "rec");
+    for (n = MINN; n <= MAXN; n += INCN) {  
+	printf("%3d ", n);
+	printf("%5.2f ", run_transpose(trans, n));
+	printf("%5.2f ", run_transpose(rtrans, n));
 	printf("\n");
 	fflush(stdout);
     }
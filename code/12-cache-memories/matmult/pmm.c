@@ -0,0 +1,198 @@
+/* parallel matrix multiply: GFLOP/s for varying sizes and thread counts */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mm.h"
+#include "gemm.h"
+#include "bench.h"
+
+#define PMINN 256
+#define PMAXN 4096
+
+/* check the result array for correctness */
+static void checkresult(double *c, int n)
+{
+    long i;
+
+    for (i = 0; i < (long) n*n; i++)
+	if (c[i] != (double)n) {
+	    printf("Error: bad number (%f) in result matrix (%ld,%ld)\n", 
+		   c[i], i / n, i % n);
+	    exit(0);
+	}
+}
+
+/*
+ * Check pdgemm against a naive multiply on random small-integer
+ * inputs (so that all sums are exact), on nthreads threads.  The
+ * shapes are not multiples of GEMM_MR or GEMM_NR, and some have
+ * k > GEMM_KC or m > GEMM_MC, so that edge tiles and blocks are split
+ * among threads too
+ */
+static void check_random(int nthreads)
+{
+    static int shapes[][3] = {{1, 1, 1}, {7, 13, 5}, {61, 37, 101},
+			      {101, 203, 301}, {257, 131, 263}};
+    int m, n, k, s;
+    long i, j, l;
+
+    srand(1);
+    for (s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+	m = shapes[s][0]; n = shapes[s][1]; k = shapes[s][2];
+	double *a = malloc((long) m*k*sizeof(double));
+	double *b = malloc((long) k*n*sizeof(double));
+	double *c = calloc((long) m*n, sizeof(double));
+	if (!a || !b || !c) {
+	    printf("Error: out of memory\n");
+	    exit(1);
+	}
+	for (i = 0; i < (long) m*k; i++)
+	    a[i] = (double) (rand() % 7 - 3);
+	for (i = 0; i < (long) k*n; i++)
+	    b[i] = (double) (rand() % 7 - 3);
+	pdgemm(nthreads, m, n, k, a, k, b, n, c, n);
+	for (i = 0; i < m; i++)
+	    for (j = 0; j < n; j++) {
+		double sum = 0.0;
+		for (l = 0; l < k; l++)
+		    sum += a[i*k + l] * b[l*n + j];
+		if (c[i*n + j] != sum) {
+		    printf("Error: pdgemm %dx%dx%d on %d threads: "
+			   "C[%ld][%ld] = %f, not %f\n",
+			   m, n, k, nthreads, i, j, c[i*n + j], sum);
+		    exit(1);
+		}
+	    }
+	free(a);
+	free(b);
+	free(c);
+    }
+}
+
+/* One n x n multiply on t threads, as a bench closure */
+typedef struct {
+    double *a, *b, *c;
+    int n, t;
+} job_t;
+
+static void zero_c(void *arg)
+{
+    job_t *j = (job_t *) arg;
+    memset(j->c, 0, (long) j->n*j->n*sizeof(double));
+}
+
+static void run_pdgemm(void *arg)
+{
+    job_t *j = (job_t *) arg;
+    pdgemm(j->t, j->n, j->n, j->n, j->a, j->n, j->b, j->n, j->c, j->n);
+}
+
+static void check_c(void *arg)
+{
+    job_t *j = (job_t *) arg;
+    checkresult(j->c, j->n);
+}
+
+static int json = 0;
+
+/*
+ * Time n x n multiply on t threads and print GFLOP/s from the median
+ * run, with its 95% confidence interval.  Wall-clock time, since the
+ * threads run on every CPU.  Large sizes get fewer samples
+ */
+static void run(double *a, double *b, double *c, int n, int t)
+{
+    job_t j = {a, b, c, n, t};
+    bench_closure_t bc = {run_pdgemm, zero_c, check_c, &j};
+    bench_params_t p = {3, 0.02, n <= 1024 ? 10 : 3, n <= 1024,
+			BENCH_FLUSH_NONE, BENCH_CLOCK_WALL};
+    bench_result_t r;
+    double flop = 2.0 * n * n * n;
+    char name[64], ci[32];
+
+    bench_run(&bc, &p, &r);
+    if (json) {
+	sprintf(name, "pmm n=%d t=%d", n, t);
+	bench_print_json(stdout, name, &r);
+    } else {
+	sprintf(ci, "(%.2f-%.2f)", flop / r.ci_hi / 1e9, flop / r.ci_lo / 1e9);
+	printf("%9.2f %-15s", flop / r.median / 1e9, ci);
+    }
+    bench_free(&r);
+}
+
+/*
+ * Report GFLOP/s for thread counts 1, 2, 4, ..., maxthreads (default:
+ * one per processor) and sizes PMINN, 2*PMINN, ..., maxn.  With -j,
+ * print each result as JSON, in seconds, instead of the table
+ */
+int main(int argc, char **argv)
+{
+    int maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxn = PMAXN;
+    int n, t;
+    long i;
+
+    if (argc > 1 && !strcmp(argv[1], "-j")) {
+	json = 1;
+	argv++;
+	argc--;
+    }
+    if (argc > 3) {
+	printf("Usage: %s [-j] [maxthreads] [maxn]\n", argv[0]);
+	printf("\t-j\tPrint each result as JSON, in seconds\n");
+	exit(0);
+    }
+    if (argc > 1)
+	maxthreads = atoi(argv[1]);
+    if (argc > 2)
+	maxn = atoi(argv[2]);
+
+    double *a = malloc((long) maxn*maxn*sizeof(double));
+    double *b = malloc((long) maxn*maxn*sizeof(double));
+    double *c = malloc((long) maxn*maxn*sizeof(double));
+    if (!a || !b || !c) {
+	printf("Error: out of memory\n");
+	exit(0);
+    }
+    for (t = 1; ; t = min(2*t, maxthreads)) {
+	check_random(t);
+	if (t == maxthreads)
+	    break;
+    }
+    check_random(3);
+    for (i = 0; i < (long) maxn*maxn; i++)
+	a[i] = b[i] = 1.0;
+
+    if (json) {
+	for (n = PMINN; n <= maxn; n *= 2)
+	    for (t = 1; ; t = min(2*t, maxthreads)) {
+		run(a, b, c, n, t);
+		if (t == maxthreads)
+		    break;
+	    }
+	exit(0);
+    }
+
+    printf("parallel matmult GFLOP/s, median (95%% CI) (columns: threads)\n");
+    printf("%5s", "n");
+    for (t = 1; ; t = min(2*t, maxthreads)) {
+	printf("%9d %-15s", t, "");
+	if (t == maxthreads)
+	    break;
+    }
+    printf("\n");
+    for (n = PMINN; n <= maxn; n *= 2) {
+	printf("%5d", n);
+	fflush(stdout);
+	for (t = 1; ; t = min(2*t, maxthreads)) {
+	    run(a, b, c, n, t);
+	    fflush(stdout);
+	    if (t == maxthreads)
+		break;
+	}
+	printf("\n");
+    }
+    exit(0);
+}
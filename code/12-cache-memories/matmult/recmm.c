@@ -0,0 +1,174 @@
+/* 
+ * recmm.c - Cache-oblivious matrix multiply and transpose, in
+ *           row-major and Morton (Z-order) layouts
+ */
+#include <string.h>
+#include "mm.h"
+#include "recmm.h"
+
+#define LD (MAXN+513)   /* Row length of array */
+
+/* Leaf kernel: C += A*B for m x k and k x n blocks with row lengths
+   lda, ldb, ldc.  The ikj order streams rows of B and C, and the
+   inner loop vectorizes */
+static void leaf_mm(const double *restrict A, const double *restrict B,
+		    double *restrict C, int m, int n, int k,
+		    int lda, int ldb, int ldc)
+{
+    int i, j, p;
+
+    for (i = 0; i < m; i++) {
+	double *c = C + i*ldc;
+	for (p = 0; p < k; p++) {
+	    double r = A[i*lda + p];
+	    const double *b = B + p*ldb;
+	    for (j = 0; j < n; j++)
+		c[j] += r*b[j];
+	}
+    }
+}
+
+/* C += A*B for m x k and k x n blocks of row-major arrays, halving
+   the largest of m, n and k */
+static void rec_mm(const double *A, const double *B, double *C,
+		   int m, int n, int k)
+{
+    if (m <= REC_LEAF && n <= REC_LEAF && k <= REC_LEAF) {
+	leaf_mm(A, B, C, m, n, k, LD, LD, LD);
+    } else if (m >= n && m >= k) {
+	int h = m/2;
+	rec_mm(A, B, C, h, n, k);
+	rec_mm(A + h*LD, B, C + h*LD, m-h, n, k);
+    } else if (n >= k) {
+	int h = n/2;
+	rec_mm(A, B, C, m, h, k);
+	rec_mm(A, B + h, C + h, m, n-h, k);
+    } else {
+	int h = k/2;
+	rec_mm(A, B, C, m, n, h);
+	rec_mm(A + h, B + h*LD, C, m, n, k-h);
+    }
+}
+
+void rmm(array A, array B, array C, int n)
+{
+    rec_mm(&A[0][0], &B[0][0], &C[0][0], n, n, n);
+}
+
+/*
+ * Morton layout.  The matrix is cut into a 2^l x 2^l grid of b x b
+ * tiles, with l the smallest level giving b <= REC_LEAF, so padding
+ * is less than one tile per row.  Each tile is stored row-major and
+ * tiles are stored in Z order, so each quadrant of a 2^j x 2^j block
+ * of tiles is a contiguous quarter of it.
+ */
+#define ZMAX (1 << 20)          /* Room for padded MAXN x MAXN */
+static double za[ZMAX], zb[ZMAX], zc[ZMAX];
+
+/* Interleave bits of tile row r and column c: Z-order tile index */
+static long morton(int r, int c)
+{
+    long z = 0;
+    int bit;
+
+    for (bit = 0; (r >> bit) || (c >> bit); bit++)
+	z |= (long) (((c >> bit) & 1) | (((r >> bit) & 1) << 1)) << (2*bit);
+    return z;
+}
+
+/* Copy n x n array into Morton buffer of g x g tiles of size b */
+static void to_morton(array A, double *z, int n, int g, int b)
+{
+    int tr, tc, i, j;
+
+    for (tr = 0; tr < g; tr++)
+	for (tc = 0; tc < g; tc++) {
+	    double *t = z + morton(tr, tc) * b*b;
+	    for (i = 0; i < b; i++)
+		for (j = 0; j < b; j++) {
+		    int r = tr*b + i, c = tc*b + j;
+		    t[i*b + j] = (r < n && c < n) ? A[r][c] : 0.0;
+		}
+	}
+}
+
+/* Add Morton buffer back into n x n array */
+static void add_from_morton(array A, double *z, int n, int g, int b)
+{
+    int tr, tc, i, j;
+
+    for (tr = 0; tr < g; tr++)
+	for (tc = 0; tc < g; tc++) {
+	    double *t = z + morton(tr, tc) * b*b;
+	    for (i = 0; i < b && tr*b + i < n; i++)
+		for (j = 0; j < b && tc*b + j < n; j++)
+		    A[tr*b + i][tc*b + j] += t[i*b + j];
+	}
+}
+
+/* C += A*B for s x s blocks of tiles of size b in Morton order */
+static void z_mm(const double *A, const double *B, double *C, int s, int b)
+{
+    if (s == 1) {
+	leaf_mm(A, B, C, b, b, b, b, b, b);
+    } else {
+	long q = (long) (s/2) * (s/2) * b*b;  /* Quadrant size */
+	int h = s/2;
+	/* Quadrant 0: top left, 1: top right, 2: bottom left, 3: bottom right */
+	z_mm(A,       B,       C,       h, b);
+	z_mm(A + q,   B + 2*q, C,       h, b);
+	z_mm(A,       B + q,   C + q,   h, b);
+	z_mm(A + q,   B + 3*q, C + q,   h, b);
+	z_mm(A + 2*q, B,       C + 2*q, h, b);
+	z_mm(A + 3*q, B + 2*q, C + 2*q, h, b);
+	z_mm(A + 2*q, B + q,   C + 3*q, h, b);
+	z_mm(A + 3*q, B + 3*q, C + 3*q, h, b);
+    }
+}
+
+void zmm(array A, array B, array C, int n)
+{
+    int g = 1, b = n;
+
+    while (b > REC_LEAF) {
+	g *= 2;
+	b = (n + g - 1) / g;
+    }
+    to_morton(A, za, n, g, b);
+    to_morton(B, zb, n, g, b);
+    memset(zc, 0, (long) g*g*b*b * sizeof(double));
+    z_mm(za, zb, zc, g, b);
+    add_from_morton(C, zc, n, g, b);
+}
+
+void trans(array A, array B, array C, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++)
+	for (j = 0; j < n; j++)
+	    C[j][i] = A[i][j];
+}
+
+/* Transpose m x n block of A into C, halving the larger dimension */
+static void rec_trans(const double *A, double *C, int m, int n)
+{
+    int i, j;
+
+    if (m <= REC_LEAF/2 && n <= REC_LEAF/2) {
+	for (i = 0; i < m; i++)
+	    for (j = 0; j < n; j++)
+		C[j*LD + i] = A[i*LD + j];
+    } else if (m >= n) {
+	rec_trans(A, C, m/2, n);
+	rec_trans(A + (m/2)*LD, C + m/2, m - m/2, n);
+    } else {
+	rec_trans(A, C, m, n/2);
+	rec_trans(A + n/2, C + (n/2)*LD, m, n - n/2);
+    }
+}
+
+void rtrans(array A, array B, array C, int n)
+{
+    rec_trans(&A[0][0], &C[0][0], n, n);
+}
@@ -0,0 +1,26 @@
+/* Cache-oblivious matrix multiply and transpose */
+
+/*
+ * Recursive divide and conquer: split the largest dimension in half
+ * until the subproblem fits a leaf, so that at some level of the
+ * recursion the working set fits each level of the cache hierarchy,
+ * whatever its size.  No block size needs tuning.
+ */
+
+/* Subproblems with every dimension at most this are done by a leaf
+   kernel.  Three 32x32 blocks of doubles fill 24KB, within any L1 */
+#define REC_LEAF 32
+
+/* C += A*B, recursing on the row-major arrays in place */
+void rmm(array A, array B, array C, int n);
+
+/* C += A*B, after converting A, B and C to Morton (Z-order) layout
+   of leaf tiles, so that every quadrant is contiguous.  Conversion
+   time is included */
+void zmm(array A, array B, array C, int n);
+
+/* C = transpose of A, by rows of A (B unused) */
+void trans(array A, array B, array C, int n);
+
+/* C = transpose of A, recursively (B unused) */
+void rtrans(array A, array B, array C, int n);
@@ -1,9 +1,21 @@
 /* mountain.c - Generate the memory mountain. */
+/* Not shown in the text: needs _GNU_SOURCE for CPU affinity */
+#define _GNU_SOURCE
 /* $begin mountainmain */
 #include <stdlib.h>
 #include <stdio.h>
 #include "fcyc2.h" /* measurement routines */
 #include "clock.h" /* routines to access the cycle counter */
+/* $end mountainmain */
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+/* $begin mountainmain */
 
 #define MINBYTES (1 << 14)  /* First working set size */
 #define MAXBYTES (1 << 27)  /* Last working set size */
@@ -19,45 +31,258 @@ void init_data(long *data, int n);
 int test(int elems, int stride);
 double run(int size, int stride, double Mhz);
 
+/*
+ * Other access modes and multiple threads.  Each mode is a kernel
+ * that sweeps elems elements of buf with the given stride.  With
+ * nthreads > 1, every thread sweeps its own private copy of the
+ * working set (thread 0's copy is data), or with -s all threads
+ * sweep data.  Throughput is summed over threads.
+ */
+typedef long (*kernel_t)(long *buf, long elems, long stride);
+
+long read_kernel(long *buf, long elems, long stride);
+long write_kernel(long *buf, long elems, long stride);
+long rmw_kernel(long *buf, long elems, long stride);
+long nt_kernel(long *buf, long elems, long stride);
+
+#define NMODES 4
+char *mode_names[NMODES] = {"read", "write", "rmw", "nt"};
+kernel_t kernels[NMODES] = {read_kernel, write_kernel, rmw_kernel, nt_kernel};
+
+#define MAXTHREADS 256
+/* Each thread sweeps at least this many elements per timed call, so
+   that barrier cost is small next to the sweeps */
+#define MINSWEEP (1 << 18)
+
+int nthreads = 1;
+int shared = 0;
+long *region[MAXTHREADS];
+void start_threads();
+void stop_threads();
+double run_mode(int mode, int size, int stride, double Mhz);
+double run_kernel(kernel_t kernel, int size, int stride, double Mhz);
+
+/*
+ * Vector read kernels for stride 1, with four independent vector
+ * accumulators so that adds never limit the load rate.  With -v the
+ * read mountain gets an extra column for the chosen kernel, and a
+ * table of peak L1 and L2 read bandwidth, scalar against vector.
+ */
+long sse2_kernel(long *buf, long elems, long stride);
+long avx2_kernel(long *buf, long elems, long stride);
+long avx512_kernel(long *buf, long elems, long stride);
+char *simd_names[] = {"sse2", "avx2", "avx512"};
+kernel_t simd_kernels[] = {sse2_kernel, avx2_kernel, avx512_kernel};
+int simd = -1;   /* Index into simd_kernels, or -1 for none */
+int select_simd(char *name);
+void usage(char *prog);
+
+/*
+ * Load latency.  Follows a chain of pointers, one per cache line,
+ * linked in a random cyclic order, so each load depends on the last
+ * and prefetchers cannot guess the next line.
+ */
+#define LINE 64
+#define CHASE_STEPS (1 << 20)
+void latency(double Mhz);
+
+/* Page policies for the chains: small pages, transparent huge
+   pages, or MAP_HUGETLB 2MB or 1GB pages */
+#define PAGES_4K 0
+#define PAGES_THP 1
+#define PAGES_2M 2
+#define PAGES_1G 3
+#define NPAGES 4
+char *page_names[NPAGES] = {"4k", "thp", "2m", "1g"};
+int pageset[NPAGES] = {1, 0, 0, 0};
+long maxspan = 1L << 30;   /* Largest span for the TLB sweep */
+#define TLB_PAGE 4096
+#define TLB_MINSPAN (1L << 16)
+#define KNEE 1.3   /* Latency rise from the previous span marking a knee */
+void tlb_sweep(double Mhz);
+
 /* $begin mountainmain */
-int main()
+int main(int argc, char *argv[])
 {
     int size;        /* Working set size (in bytes) */
     int stride;      /* Stride (in array elements) */
     double Mhz;      /* Clock frequency */
+/* $end mountainmain */
+    /* Not shown in the text */
+    int modes[NMODES] = {1, 0, 0, 0};
+    int mode, c, lat = 0, tlb = 0, mset = 0, lev, p;
+    char *end;
+    double bw, peak[2][2] = {{0, 0}, {0, 0}};  /* [L1, L2][scalar, simd] */
+    char *tok;
+
+    while ((c = getopt(argc, argv, "m:t:slHP:TG:v:h")) != -1) {
+	switch (c) {
+	case 'm':
+	    mset = 1;
+	    memset(modes, 0, sizeof(modes));
+	    for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+		if (!strcmp(tok, "all")) {
+		    for (mode = 0; mode < NMODES; mode++)
+			modes[mode] = 1;
+		    continue;
+		}
+		for (mode = 0; mode < NMODES; mode++)
+		    if (!strcmp(tok, mode_names[mode]))
+			break;
+		if (mode == NMODES)
+		    usage(argv[0]);
+		modes[mode] = 1;
+	    }
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    if (nthreads < 1 || nthreads > MAXTHREADS)
+		usage(argv[0]);
+	    break;
+	case 's':
+	    shared = 1;
+	    break;
+	case 'l':
+	    lat = 1;
+	    break;
+	case 'H':
+	    memset(pageset, 0, sizeof(pageset));
+	    pageset[PAGES_2M] = 1;
+	    break;
+	case 'P':
+	    memset(pageset, 0, sizeof(pageset));
+	    for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+		for (p = 0; p < NPAGES; p++)
+		    if (!strcmp(tok, page_names[p]))
+			break;
+		if (p == NPAGES)
+		    usage(argv[0]);
+		pageset[p] = 1;
+	    }
+	    break;
+	case 'T':
+	    tlb = 1;
+	    break;
+	case 'G':
+	    maxspan = strtol(optarg, &end, 10);
+	    if (*end == 'g' || *end == 'G')
+		maxspan <<= 30;
+	    else if (*end == 'm' || *end == 'M')
+		maxspan <<= 20;
+	    else if (*end == 'k' || *end == 'K')
+		maxspan <<= 10;
+	    if (maxspan < TLB_MINSPAN || maxspan > (1L << 40))
+		usage(argv[0]);
+	    break;
+	case 'v':
+	    if (!select_simd(optarg)) {
+		fprintf(stderr, "Kernel %s unknown or unsupported\n", optarg);
+		exit(1);
+	    }
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if ((lat || tlb) && !mset)
+	modes[0] = 0;
 
+    /* Not shown in the text.  Before mhz, which pins this thread
+       and so would hide the CPUs the threads may use */
+    start_threads();
+/* $begin mountainmain */
     init_data(data, MAXELEMS); /* Initialize each element in data */
     Mhz = mhz(0);              /* Estimate the clock frequency */
 /* $end mountainmain */
     /* Not shown in the text */
     printf("Clock frequency is approx. %.1f MHz\n", Mhz);
-    printf("Memory mountain (MB/sec)\n");
 
-    printf("\t");
-    for (stride = 1; stride <= MAXSTRIDE; stride++)
-	printf("s%d\t", stride);
-    printf("\n");
+    for (mode = 0; mode < NMODES; mode++) {
+	if (!modes[mode])
+	    continue;
+	if (mode == 0 && nthreads == 1)
+	    printf("Memory mountain (MB/sec)\n");
+	else
+	    printf("Memory mountain, %s, %d thread%s%s (MB/sec)\n",
+		   mode_names[mode], nthreads, nthreads > 1 ? "s" : "",
+		   nthreads == 1 ? "" : shared ? ", shared" : ", private");
+
+	printf("\t");
+	for (stride = 1; stride <= MAXSTRIDE; stride++)
+	    printf("s%d\t", stride);
+	if (mode == 0 && simd >= 0)
+	    printf("%s\t", simd_names[simd]);
+	printf("\n");
 
- /* $begin mountainmain */
-    for (size = MAXBYTES; size >= MINBYTES; size >>= 1) {
+/* $begin mountainmain */
+	for (size = MAXBYTES; size >= MINBYTES; size >>= 1) {
 /* $end mountainmain */
-	/* Not shown in the text */
-	if (size > (1 << 20))
-	    printf("%dm\t", size / (1 << 20));
-	else
-	    printf("%dk\t", size / 1024);
+	    /* Not shown in the text */
+	    if (size > (1 << 20))
+		printf("%dm\t", size / (1 << 20));
+	    else
+		printf("%dk\t", size / 1024);
 
 /* $begin mountainmain */
-	for (stride = 1; stride <= MAXSTRIDE; stride++) {
-	    printf("%.0f\t", run(size, stride, Mhz));
-	    
+	    for (stride = 1; stride <= MAXSTRIDE; stride++) {
+/* $end mountainmain */
+		/* Not shown in the text */
+		if (mode == 0 && nthreads == 1)
+		    bw = run(size, stride, Mhz);
+		else
+		    bw = run_mode(mode, size, stride, Mhz);
+		printf("%.0f\t", bw);
+		lev = size <= sysconf(_SC_LEVEL1_DCACHE_SIZE) ? 0 :
+		    size <= sysconf(_SC_LEVEL2_CACHE_SIZE) ? 1 : -1;
+		if (mode == 0 && stride == 1 && lev >= 0 && bw > peak[lev][0])
+		    peak[lev][0] = bw;
+	    }
+	    if (mode == 0 && simd >= 0) {
+		bw = run_kernel(simd_kernels[simd], size, 1, Mhz);
+		printf("%.0f\t", bw);
+		if (lev >= 0 && bw > peak[lev][1])
+		    peak[lev][1] = bw;
+	    }
+	    printf("\n");
 	}
+/* $end mountainmain */
+	/* Not shown in the text */
 	printf("\n");
+	if (mode == 0 && simd >= 0) {
+	    printf("Peak stride-1 read (MB/sec)\n");
+	    printf("\tscalar\t%s\n", simd_names[simd]);
+	    printf("L1\t%.0f\t%.0f\n", peak[0][0], peak[0][1]);
+	    printf("L2\t%.0f\t%.0f\n\n", peak[1][0], peak[1][1]);
+	}
     }
+    /* Only this thread chases pointers; the others would compete */
+    stop_threads();
+    if (lat)
+	latency(Mhz);
+    if (tlb)
+	tlb_sweep(Mhz);
+/* $begin mountainmain */
     exit(0);
 }
 /* $end mountainmain */
 
+void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-m read,write,rmw,nt|all] [-t nthreads] [-s] "
+	    "[-v auto|sse2|avx2|avx512] [-l] [-T [-G maxspan]] "
+	    "[-P 4k,thp,2m,1g | -H]\n", prog);
+    fprintf(stderr, "  -m  Access modes, one mountain each (default read)\n");
+    fprintf(stderr, "  -t  Threads, each sweeping its own copy of the working set\n");
+    fprintf(stderr, "  -s  Threads all sweep one shared working set\n");
+    fprintf(stderr, "  -v  Add a vector stride-1 column to the read mountain\n");
+    fprintf(stderr, "  -l  Load latency by pointer chasing (alone unless -m)\n");
+    fprintf(stderr, "  -T  TLB sweep, one access per 4KB page (alone unless -m)\n");
+    fprintf(stderr, "  -G  Largest TLB sweep span, e.g. 4g (default 1g)\n");
+    fprintf(stderr, "  -P  Page policies for -l and -T, one column each\n");
+    fprintf(stderr, "  -H  Same as -P 2m\n");
+    exit(1);
+}
+
 /* init_data - initializes the array */
 void init_data(long *data, int n)
 {
@@ -109,3 +334,523 @@ double run(int size, int stride, double Mhz)
 /* $end mountainfuns */
 
 
+
+/* The kernels use 4x4 unrolling like test */
+
+long read_kernel(long *buf, long elems, long stride)
+{
+    long i, sx2 = stride*2, sx3 = stride*3, sx4 = stride*4;
+    long acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+    long limit = elems - sx4;
+
+    for (i = 0; i < limit; i += sx4) {
+	acc0 = acc0 + buf[i];
+	acc1 = acc1 + buf[i+stride];
+	acc2 = acc2 + buf[i+sx2];
+	acc3 = acc3 + buf[i+sx3];
+    }
+    for (; i < elems; i++)
+	acc0 = acc0 + buf[i];
+    return ((acc0 + acc1) + (acc2 + acc3));
+}
+
+long write_kernel(long *buf, long elems, long stride)
+{
+    long i, sx2 = stride*2, sx3 = stride*3, sx4 = stride*4;
+    long limit = elems - sx4;
+
+    for (i = 0; i < limit; i += sx4) {
+	buf[i] = i;
+	buf[i+stride] = i;
+	buf[i+sx2] = i;
+	buf[i+sx3] = i;
+    }
+    for (; i < elems; i++)
+	buf[i] = i;
+    return 0;
+}
+
+long rmw_kernel(long *buf, long elems, long stride)
+{
+    long i, sx2 = stride*2, sx3 = stride*3, sx4 = stride*4;
+    long limit = elems - sx4;
+
+    for (i = 0; i < limit; i += sx4) {
+	buf[i]++;
+	buf[i+stride]++;
+	buf[i+sx2]++;
+	buf[i+sx3]++;
+    }
+    for (; i < elems; i++)
+	buf[i]++;
+    return 0;
+}
+
+/* Streaming stores bypass the cache, so there is no read for
+   ownership.  Falls back to ordinary stores off x86-64 */
+long nt_kernel(long *buf, long elems, long stride)
+{
+#ifdef __x86_64__
+    long i, sx2 = stride*2, sx3 = stride*3, sx4 = stride*4;
+    long limit = elems - sx4;
+
+    for (i = 0; i < limit; i += sx4) {
+	_mm_stream_si64((long long *) &buf[i], i);
+	_mm_stream_si64((long long *) &buf[i+stride], i);
+	_mm_stream_si64((long long *) &buf[i+sx2], i);
+	_mm_stream_si64((long long *) &buf[i+sx3], i);
+    }
+    for (; i < elems; i++)
+	_mm_stream_si64((long long *) &buf[i], i);
+    _mm_sfence();
+    return 0;
+#else
+    return write_kernel(buf, elems, stride);
+#endif
+}
+
+/* Vector kernels ignore stride; elems must be a multiple of 16 */
+#ifdef __x86_64__
+long sse2_kernel(long *buf, long elems, long stride)
+{
+    __m128i acc0 = _mm_setzero_si128(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    long i;
+
+    for (i = 0; i < elems; i += 8) {
+	acc0 = _mm_add_epi64(acc0, _mm_loadu_si128((__m128i *) &buf[i]));
+	acc1 = _mm_add_epi64(acc1, _mm_loadu_si128((__m128i *) &buf[i+2]));
+	acc2 = _mm_add_epi64(acc2, _mm_loadu_si128((__m128i *) &buf[i+4]));
+	acc3 = _mm_add_epi64(acc3, _mm_loadu_si128((__m128i *) &buf[i+6]));
+    }
+    acc0 = _mm_add_epi64(_mm_add_epi64(acc0, acc1), _mm_add_epi64(acc2, acc3));
+    return _mm_cvtsi128_si64(acc0) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc0, acc0));
+}
+
+__attribute__((target("avx2")))
+long avx2_kernel(long *buf, long elems, long stride)
+{
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    long i, out[4];
+
+    for (i = 0; i < elems; i += 16) {
+	acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256((__m256i *) &buf[i]));
+	acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256((__m256i *) &buf[i+4]));
+	acc2 = _mm256_add_epi64(acc2, _mm256_loadu_si256((__m256i *) &buf[i+8]));
+	acc3 = _mm256_add_epi64(acc3, _mm256_loadu_si256((__m256i *) &buf[i+12]));
+    }
+    acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+			    _mm256_add_epi64(acc2, acc3));
+    _mm256_storeu_si256((__m256i *) out, acc0);
+    return out[0] + out[1] + out[2] + out[3];
+}
+
+__attribute__((target("avx512f")))
+long avx512_kernel(long *buf, long elems, long stride)
+{
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    long i;
+
+    for (i = 0; i < elems; i += 32) {
+	acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(&buf[i]));
+	acc1 = _mm512_add_epi64(acc1, _mm512_loadu_si512(&buf[i+8]));
+	acc2 = _mm512_add_epi64(acc2, _mm512_loadu_si512(&buf[i+16]));
+	acc3 = _mm512_add_epi64(acc3, _mm512_loadu_si512(&buf[i+24]));
+    }
+    acc0 = _mm512_add_epi64(_mm512_add_epi64(acc0, acc1),
+			    _mm512_add_epi64(acc2, acc3));
+    return _mm512_reduce_add_epi64(acc0);
+}
+#else
+long sse2_kernel(long *buf, long elems, long stride)
+{
+    return read_kernel(buf, elems, 1);
+}
+long avx2_kernel(long *buf, long elems, long stride)
+{
+    return read_kernel(buf, elems, 1);
+}
+long avx512_kernel(long *buf, long elems, long stride)
+{
+    return read_kernel(buf, elems, 1);
+}
+#endif
+
+/* select_simd - Choose vector kernel by name.  "auto" picks the
+ *               widest one the CPU has.  Returns 0 if the name is
+ *               unknown or the CPU lacks the instructions.
+ */
+int select_simd(char *name)
+{
+    int k;
+
+#ifdef __x86_64__
+    int have[3] = {1, __builtin_cpu_supports("avx2"),
+		   __builtin_cpu_supports("avx512f")};
+#else
+    int have[3] = {0, 0, 0};
+#endif
+    if (!strcmp(name, "auto")) {
+	for (k = 2; k >= 0 && !have[k]; k--)
+	    ;
+	simd = k;
+	return k >= 0;
+    }
+    for (k = 0; k < 3; k++)
+	if (!strcmp(name, simd_names[k]) && have[k]) {
+	    simd = k;
+	    return 1;
+	}
+    return 0;
+}
+
+/*
+ * Thread pool.  Workers spin at a barrier between sweeps; the caller
+ * is thread 0 and times from its first barrier to its second.  Thread
+ * i runs on the i-th CPU (modulo count) that the process may use.
+ */
+static struct {
+    kernel_t kernel;
+    long elems, stride, reps;
+} job;
+static volatile int bar_count = 0;
+static volatile long bar_gen = 0;
+static volatile long sink;
+static volatile int stopping = 0;
+static int cpus[CPU_SETSIZE];
+static int ncpus = 0;
+
+static void barrier()
+{
+    long gen = __atomic_load_n(&bar_gen, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&bar_count, 1, __ATOMIC_ACQ_REL) == nthreads) {
+	bar_count = 0;
+	__atomic_store_n(&bar_gen, gen + 1, __ATOMIC_RELEASE);
+    } else {
+	while (__atomic_load_n(&bar_gen, __ATOMIC_ACQUIRE) == gen)
+	    sched_yield();
+    }
+}
+
+static void sweep(int id)
+{
+    long *buf = shared ? data : region[id];
+    long r, acc = 0;
+
+    for (r = 0; r < job.reps; r++)
+	acc += job.kernel(buf, job.elems, job.stride);
+    sink = acc;
+}
+
+static int par_test(int elems, int stride)
+{
+    barrier();
+    sweep(0);
+    barrier();
+    return 0;
+}
+
+/* Pin thread id to its CPU, warning if that fails */
+static void pin_thread(int id)
+{
+    int cpu = cpus[id % ncpus];
+    if (cpu >= 0 && pin_cpu(cpu) < 0)
+	fprintf(stderr, "Warning: can't pin thread %d to CPU %d\n", id, cpu);
+}
+
+static void *worker(void *vargp)
+{
+    int id = (long) vargp;
+
+    pin_thread(id);
+    /* First touch by the owner places pages on its NUMA node */
+    if (!shared) {
+	region[id] = aligned_alloc(64, MAXBYTES);
+	if (!region[id]) {
+	    fprintf(stderr, "Out of memory for thread %d\n", id);
+	    exit(1);
+	}
+	init_data(region[id], MAXELEMS);
+    }
+    barrier();
+    while (1) {
+	barrier();
+	if (stopping)
+	    break;
+	sweep(id);
+	barrier();
+    }
+    return NULL;
+}
+
+/* Start threads 1..nthreads-1 and wait until their data is ready */
+void start_threads()
+{
+    pthread_t tid;
+    cpu_set_t set;
+    long i;
+
+    region[0] = data;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+	for (i = 0; i < CPU_SETSIZE; i++)
+	    if (CPU_ISSET(i, &set))
+		cpus[ncpus++] = i;
+    }
+    if (ncpus == 0) {
+	fprintf(stderr, "Warning: can't get CPU affinity.  Threads not pinned\n");
+	cpus[ncpus++] = -1;
+    }
+    pin_thread(0);
+    for (i = 1; i < nthreads; i++) {
+	if (pthread_create(&tid, NULL, worker, (void *) i) != 0) {
+	    fprintf(stderr, "Can't create thread %ld\n", i);
+	    exit(1);
+	}
+	pthread_detach(tid);
+    }
+    barrier();
+}
+
+/* Have threads 1..nthreads-1 exit, rather than spin at the barrier
+   through measurements that only thread 0 makes */
+void stop_threads()
+{
+    if (nthreads == 1 || stopping)
+	return;
+    stopping = 1;
+    barrier();
+}
+
+/* run_kernel - Like run, for any kernel and thread count.  Returns
+ *              throughput summed over all threads (MB/s).  For rmw,
+ *              each element updated counts once.
+ */
+double run_kernel(kernel_t kernel, int size, int stride, double Mhz)
+{
+    double cycles;
+    long elems = size / sizeof(long);
+
+    job.kernel = kernel;
+    job.elems = elems;
+    job.stride = stride;
+    job.reps = (MINSWEEP + elems / stride - 1) / (elems / stride);
+    if (nthreads == 1)
+	job.reps = 1;
+    cycles = fcyc2(par_test, elems, stride, 0);
+    return (double) nthreads * job.reps * (size / stride) / (cycles / Mhz);
+}
+
+double run_mode(int mode, int size, int stride, double Mhz)
+{
+    return run_kernel(kernels[mode], size, stride, Mhz);
+}
+
+/* Latency test state */
+static void **chain;
+static void * volatile chase_end;
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static size_t page_round(size_t bytes, int policy)
+{
+    size_t psize = policy == PAGES_1G ? 1UL << 30 :
+	policy == PAGES_2M ? 1UL << 21 : 1UL << 12;
+    return (bytes + psize - 1) & ~(psize - 1);
+}
+
+/* alloc_buf - Map bytes of memory with page policy *policy.  If
+ *             MAP_HUGETLB fails, falls back to the next smaller page
+ *             size and then to transparent huge pages, updating *policy.
+ */
+void *alloc_buf(size_t bytes, int *policy)
+{
+    void *p;
+
+    while (*policy == PAGES_1G || *policy == PAGES_2M) {
+	int flags = *policy == PAGES_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+	p = mmap(NULL, page_round(bytes, *policy), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags, -1, 0);
+	if (p != MAP_FAILED)
+	    return p;
+	fprintf(stderr, "MAP_HUGETLB %s pages failed, trying %s\n",
+		page_names[*policy], page_names[*policy - 1]);
+	(*policy)--;
+    }
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+	perror("mmap");
+	exit(1);
+    }
+    madvise(p, bytes, *policy == PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    return p;
+}
+
+void free_buf(void *p, size_t bytes, int policy)
+{
+    munmap(p, page_round(bytes, policy));
+}
+
+/* make_chain - Link n nodes spaced bytes apart in chain into one
+ *              random cycle (Sattolo's algorithm).  Nodes sit at
+ *              different line offsets when spacing exceeds a line, so
+ *              that they do not all map to the same cache sets.
+ */
+void make_chain(long n, long spacing)
+{
+    static long *perm = NULL;
+    static long nperm = 0;
+    long i, j, t;
+    char *base = (char *) chain;
+    unsigned long long r = 15213;
+
+    if (n > nperm) {
+	free(perm);
+	perm = malloc(n * sizeof(long));
+	nperm = n;
+    }
+    for (i = 0; i < n; i++)
+	perm[i] = i;
+    for (i = n - 1; i > 0; i--) {
+	r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+	j = (r >> 33) % i;
+	t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+    }
+    /* After the shuffle, perm is one cycle: i -> perm[i] */
+    for (i = 0; i < n; i++)
+	*(void **) (base + i * spacing + (i * LINE) % spacing) =
+	    base + perm[i] * spacing + (perm[i] * LINE) % spacing;
+}
+
+/* chase - Follow steps links of the chain */
+int chase(int steps, int unused)
+{
+    void **p = chain;
+    long i;
+
+    for (i = 0; i < steps; i += 8) {
+	p = *p; p = *p; p = *p; p = *p;
+	p = *p; p = *p; p = *p; p = *p;
+    }
+    chase_end = p;
+    return 0;
+}
+
+/* chase_cycles - Cycles per access around an n node chain */
+static double chase_cycles(long n, long spacing)
+{
+    make_chain(n, spacing);
+    return fcyc2_full(chase, CHASE_STEPS, 0, 0, 3, 0.01, 20, 0) / CHASE_STEPS;
+}
+
+static char *level(long size)
+{
+    if (size <= sysconf(_SC_LEVEL1_DCACHE_SIZE))
+	return "L1";
+    if (size <= sysconf(_SC_LEVEL2_CACHE_SIZE))
+	return "L2";
+    if (size <= sysconf(_SC_LEVEL3_CACHE_SIZE))
+	return "L3";
+    return "mem";
+}
+
+static void print_size(long size)
+{
+    if (size >= (1L << 30))
+	printf("%ldg\t", size >> 30);
+    else if (size > (1 << 20))
+	printf("%ldm\t", size >> 20);
+    else
+	printf("%ldk\t", size >> 10);
+}
+
+/* Column headers for the page policies measured.  A column whose
+   policy fell back is labeled with the one used, then the one asked
+   for in parentheses */
+static void print_page_names(int got[NPAGES])
+{
+    int p;
+
+    for (p = 0; p < NPAGES; p++) {
+	if (!pageset[p])
+	    continue;
+	if (got[p] == p)
+	    printf("%s\t", page_names[p]);
+	else
+	    printf("%s(%s)\t", page_names[got[p]], page_names[p]);
+    }
+}
+
+/* latency - Print load-to-use latency for each working set size,
+ *           one column per page policy
+ */
+void latency(double Mhz)
+{
+    long size;
+    int p, got[NPAGES];
+    double ns[NPAGES][32];
+    int row;
+
+    for (p = 0; p < NPAGES; p++) {
+	if (!pageset[p])
+	    continue;
+	got[p] = p;
+	chain = alloc_buf(MAXBYTES, &got[p]);
+	for (size = MAXBYTES, row = 0; size >= MINBYTES; size >>= 1, row++)
+	    ns[p][row] = chase_cycles(size / LINE, LINE) * 1000 / Mhz;
+	free_buf(chain, MAXBYTES, got[p]);
+    }
+    printf("Load latency (ns/access)\nsize\t");
+    print_page_names(got);
+    printf("level\n");
+    for (size = MAXBYTES, row = 0; size >= MINBYTES; size >>= 1, row++) {
+	print_size(size);
+	for (p = 0; p < NPAGES; p++)
+	    if (pageset[p])
+		printf("%.2f\t", ns[p][row]);
+	printf("%s\n", level(size));
+    }
+    printf("\n");
+}
+
+/*
+ * TLB sweep.  One dependent load per 4KB page, pages in random
+ * order, over spans from 64KB up to maxspan.  Each access needs a new
+ * translation, so latency steps up as the span outgrows the reach of
+ * each TLB level (entries times page size).  With huge pages the same
+ * span needs far fewer entries and the knees move right.
+ */
+void tlb_sweep(double Mhz)
+{
+    long span;
+    int p, got[NPAGES], row, nrow = 0;
+    double ns[NPAGES][64];
+
+    for (span = TLB_MINSPAN; span <= maxspan; span <<= 1)
+	nrow++;
+    for (p = 0; p < NPAGES; p++) {
+	if (!pageset[p])
+	    continue;
+	got[p] = p;
+	chain = alloc_buf(maxspan, &got[p]);
+	for (span = TLB_MINSPAN, row = 0; row < nrow; span <<= 1, row++)
+	    ns[p][row] = chase_cycles(span / TLB_PAGE, TLB_PAGE) * 1000 / Mhz;
+	free_buf(chain, maxspan, got[p]);
+    }
+    printf("TLB sweep, one access per 4KB page (ns/access)\nspan\tpages\t");
+    print_page_names(got);
+    printf("\n");
+    for (span = TLB_MINSPAN, row = 0; row < nrow; span <<= 1, row++) {
+	print_size(span);
+	printf("%ld\t", span / TLB_PAGE);
+	for (p = 0; p < NPAGES; p++)
+	    if (pageset[p])
+		printf("%.2f%s\t", ns[p][row],
+		       row > 0 && ns[p][row] > KNEE * ns[p][row-1] ? "*" : "");
+	printf("\n");
+    }
+    printf("* knee: latency up more than %.0f%% from the previous span\n\n",
+	   (KNEE - 1) * 100);
+}
@@ -0,0 +1,100 @@
+/*
+ * cntbench.c - Update throughput of the counter policies from 1 to
+ *              MAXTHREADS threads
+ */
+#include <getopt.h>
+#include "csapp.h"
+#include "counter.h"
+
+#define MAXTHREADS 64
+
+static counter_t cnt;
+static long niters;     /* Increments per thread */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void *worker(void *vargp)
+{
+    long i;
+
+    for (i = 0; i < niters; i++)
+	counter_add(&cnt, 1);
+    return NULL;
+}
+
+/* Run one configuration.  Return millions of increments per second */
+static double run(cnt_policy_t policy, int nthreads)
+{
+    pthread_t tid[MAXTHREADS];
+    long i, total;
+    double t;
+
+    counter_init(&cnt, policy);
+    t = now();
+    for (i = 0; i < nthreads; i++)
+	Pthread_create(&tid[i], NULL, worker, NULL);
+    for (i = 0; i < nthreads; i++)
+	Pthread_join(tid[i], NULL);
+    t = now() - t;
+    total = counter_read(&cnt);
+    counter_deinit(&cnt);
+    if (total != nthreads * niters) {
+	printf("Error: %s counter = %ld, expected %ld\n",
+	       counter_policy_name(policy), total, nthreads * niters);
+	exit(1);
+    }
+    return total / t * 1e-6;
+}
+
+static void usage(char *cmdname)
+{
+    printf("Usage: %s [-h] [-t maxthreads] [-n niters]\n", cmdname);
+    printf("\t-h\tPrint this message\n");
+    printf("\t-t tmax\tSweep thread counts 1, 2, 4, ... up to tmax (max %d)\n",
+	   MAXTHREADS);
+    printf("\t-n niters\tIncrements per thread\n");
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    int maxthreads = MAXTHREADS;
+    int c, nthreads, p;
+
+    niters = 1000000;
+    while ((c = getopt(argc, argv, "ht:n:")) != -1) {
+	switch (c) {
+	case 't':
+	    maxthreads = atoi(optarg);
+	    break;
+	case 'n':
+	    niters = atol(optarg);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (maxthreads < 1 || maxthreads > MAXTHREADS)
+	app_error("Error: invalid thread count");
+
+    printf("Millions of increments per second, %ld increments per thread\n",
+	   niters);
+    printf("threads");
+    for (p = 0; p < CNT_NPOLICY; p++)
+	printf("\t%s", counter_policy_name(p));
+    printf("\n");
+    for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+	printf("%d", nthreads);
+	for (p = 0; p < CNT_NPOLICY; p++) {
+	    printf("\t%.2f", run(p, nthreads));
+	    fflush(stdout);
+	}
+	printf("\n");
+    }
+    exit(0);
+}
@@ -0,0 +1,101 @@
+/*
+ * counter.c - Statistics counters with selectable update policy
+ *
+ * A CNT_SHARDED counter gives every thread its own cache line, so an
+ * update never moves a line between cores.  The price is paid by
+ * counter_read, which adds up all of the slots.  Threads are assigned
+ * slots round robin; if more than CNT_NSLOT threads are live, some
+ * share a slot, which is why slot updates are still atomic.
+ */
+#include "csapp.h"
+#include "counter.h"
+
+static const char *policy_names[CNT_NPOLICY] = {
+    "sem", "atomic", "relaxed", "sharded"
+};
+
+const char *counter_policy_name(cnt_policy_t policy)
+{
+    return policy_names[policy];
+}
+
+static volatile int next_slot = 0;
+static __thread int my_slot = -1;
+
+/* Allocate n cache-line-aligned, zeroed slots */
+static cnt_slot_t *alloc_slots(int n)
+{
+    cnt_slot_t *p = NULL;
+    int rc;
+
+    if ((rc = posix_memalign((void **) &p, CNT_LINE, n * sizeof(cnt_slot_t))) != 0)
+	posix_error(rc, "posix_memalign error");
+    memset(p, 0, n * sizeof(cnt_slot_t));
+    return p;
+}
+
+/* Initialize counter cp to zero */
+void counter_init(counter_t *cp, cnt_policy_t policy)
+{
+    cp->policy = policy;
+    Sem_init(&cp->mutex, 0, 1);
+    cp->total = alloc_slots(1);
+    cp->slot = (policy == CNT_SHARDED) ? alloc_slots(CNT_NSLOT) : NULL;
+}
+
+/* Clean up counter cp */
+void counter_deinit(counter_t *cp)
+{
+    Free(cp->total);
+    if (cp->slot)
+	Free(cp->slot);
+}
+
+/* $begin counter_add */
+void counter_add(counter_t *cp, long n)
+{
+    switch (cp->policy) {
+    case CNT_SEM:
+	P(&cp->mutex);
+	cp->total->val += n;
+	V(&cp->mutex);
+	break;
+    case CNT_ATOMIC:
+	__atomic_fetch_add(&cp->total->val, n, __ATOMIC_SEQ_CST);
+	break;
+    case CNT_RELAXED:
+	__atomic_fetch_add(&cp->total->val, n, __ATOMIC_RELAXED);
+	break;
+    case CNT_SHARDED:
+	if (my_slot < 0)
+	    my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED)
+		% CNT_NSLOT;
+	__atomic_fetch_add(&cp->slot[my_slot].val, n, __ATOMIC_RELAXED);
+	break;
+    }
+}
+/* $end counter_add */
+
+/* Return current value.  Concurrent updates may or may not be included */
+long counter_read(counter_t *cp)
+{
+    long sum = 0;
+    int i;
+
+    switch (cp->policy) {
+    case CNT_SEM:
+	P(&cp->mutex);
+	sum = cp->total->val;
+	V(&cp->mutex);
+	break;
+    case CNT_ATOMIC:
+    case CNT_RELAXED:
+	sum = __atomic_load_n(&cp->total->val, __ATOMIC_RELAXED);
+	break;
+    case CNT_SHARDED:
+	for (i = 0; i < CNT_NSLOT; i++)
+	    sum += __atomic_load_n(&cp->slot[i].val, __ATOMIC_RELAXED);
+	break;
+    }
+    return sum;
+}
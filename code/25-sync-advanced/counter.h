@@ -0,0 +1,52 @@
+#ifndef __COUNTER_H__
+#define __COUNTER_H__
+
+#include "csapp.h"
+
+/*
+ * Statistics counters.  All policies count exactly; they differ in how
+ * much the updating threads interfere with each other:
+ *
+ *   CNT_SEM      One shared value protected by a semaphore
+ *   CNT_ATOMIC   One shared value updated with sequentially
+ *                consistent fetch-and-add
+ *   CNT_RELAXED  One shared value updated with relaxed fetch-and-add
+ *   CNT_SHARDED  One cache line per thread, summed only when read
+ */
+typedef enum {
+    CNT_SEM,
+    CNT_ATOMIC,
+    CNT_RELAXED,
+    CNT_SHARDED
+} cnt_policy_t;
+
+#define CNT_NPOLICY 4
+
+/* Size of a cache line; every slot is padded out to this */
+#define CNT_LINE 64
+/* Number of per-thread slots in a CNT_SHARDED counter */
+#define CNT_NSLOT 64
+
+typedef struct {
+    volatile long val;
+    char pad[CNT_LINE - sizeof(long)];
+} cnt_slot_t;
+
+/* $begin countert */
+typedef struct {
+    cnt_policy_t policy;
+    sem_t mutex;              /* Protects total under CNT_SEM */
+    cnt_slot_t *total;        /* Shared value for the unsharded policies */
+    cnt_slot_t *slot;         /* CNT_NSLOT per-thread values */
+} counter_t;
+/* $end countert */
+
+void counter_init(counter_t *cp, cnt_policy_t policy);
+void counter_deinit(counter_t *cp);
+void counter_add(counter_t *cp, long n);
+long counter_read(counter_t *cp);
+
+/* Printable name of a policy */
+const char *counter_policy_name(cnt_policy_t policy);
+
+#endif /* __COUNTER_H__ */
@@ -4,19 +4,19 @@
  */
 /* $begin echo_cnt */
 #include "csapp.h"
+#include "counter.h"
 
-static int byte_cnt;  /* Byte counter */
-static sem_t mutex;   /* and the mutex that protects it */
+static counter_t byte_cnt;  /* Byte counter, one slot per thread */
 
 static void init_echo_cnt(void)
 {
-    Sem_init(&mutex, 0, 1);
-    byte_cnt = 0;
+    counter_init(&byte_cnt, CNT_SHARDED);
 }
 
 void echo_cnt(int connfd) 
 {
     int n; 
+    long conn_cnt = 0;
     char buf[MAXLINE]; 
     rio_t rio;
     static pthread_once_t once = PTHREAD_ONCE_INIT;
@@ -24,13 +24,14 @@ void echo_cnt(int connfd)
     Pthread_once(&once, init_echo_cnt); //line:conc:pre:pthreadonce
     Rio_readinitb(&rio, connfd);        //line:conc:pre:rioinitb
     while((n = Rio_readlineb(&rio, buf, MAXLINE)) != 0) {
-	P(&mutex);
-	byte_cnt += n; //line:conc:pre:cntaccess1
-	printf("thread %d received %d (%d total) bytes on fd %d\n", 
-	       (int) pthread_self(), n, byte_cnt, connfd); //line:conc:pre:cntaccess2
-	V(&mutex);
+	counter_add(&byte_cnt, n); //line:conc:pre:cntaccess1
+	conn_cnt += n;
 	Rio_writen(connfd, buf, n);
     }
+    /* Totals are only summed once per connection */
+    printf("thread %d received %ld bytes on fd %d (%ld total)\n", 
+	   (int) pthread_self(), conn_cnt, connfd,
+	   counter_read(&byte_cnt)); //line:conc:pre:cntaccess2
 }
 /* $end echo_cnt */
 
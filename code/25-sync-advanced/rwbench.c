@@ -0,0 +1,134 @@
+/*
+ * rwbench.c - Throughput of the rwlock policies over read/write mixes
+ *             and thread counts
+ *
+ * Each thread performs a fixed number of operations on a small shared
+ * table.  An operation is a read (sum the table) with the given
+ * probability and a write (rewrite every entry) otherwise.  Readers
+ * check that they never observe a half-written table.
+ */
+#include <getopt.h>
+#include "csapp.h"
+#include "rwlock.h"
+
+#define MAXTHREADS 64
+#define NDATA 16
+
+static rwlock_t lock;
+static long table[NDATA];       /* Shared data guarded by lock */
+static long nops;               /* Operations per thread */
+static int read_pct;            /* Percentage of operations that read */
+static volatile long errors;    /* Torn reads observed */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* Thread routine: nops mixed reads and writes */
+static void *worker(void *vargp)
+{
+    unsigned int seed = (unsigned int) (long) vargp;
+    long i, j, sum;
+
+    for (i = 0; i < nops; i++) {
+	if ((int) (rand_r(&seed) % 100) < read_pct) {
+	    rwlock_rdlock(&lock);
+	    for (sum = 0, j = 0; j < NDATA; j++)
+		sum += table[j];
+	    if (sum != NDATA * table[0])
+		__atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+	    rwlock_rdunlock(&lock);
+	} else {
+	    rwlock_wrlock(&lock);
+	    for (j = 0; j < NDATA; j++)
+		table[j]++;
+	    rwlock_wrunlock(&lock);
+	}
+    }
+    return NULL;
+}
+
+/* Run one configuration.  Return millions of operations per second */
+static double run(rw_policy_t policy, int nthreads, int pct)
+{
+    pthread_t tid[MAXTHREADS];
+    long i;
+    double t;
+
+    rwlock_init(&lock, policy);
+    memset(table, 0, sizeof(table));
+    read_pct = pct;
+    t = now();
+    for (i = 0; i < nthreads; i++)
+	Pthread_create(&tid[i], NULL, worker, (void *) (i+1));
+    for (i = 0; i < nthreads; i++)
+	Pthread_join(tid[i], NULL);
+    t = now() - t;
+    rwlock_deinit(&lock);
+    if (errors) {
+	printf("Error: %s lock allowed %ld torn reads\n",
+	       rwlock_policy_name(policy), errors);
+	exit(1);
+    }
+    return nthreads * nops / t * 1e-6;
+}
+
+static void usage(char *cmdname)
+{
+    printf("Usage: %s [-h] [-t maxthreads] [-n nops] [-r readpct]\n", cmdname);
+    printf("\t-h\tPrint this message\n");
+    printf("\t-t tmax\tSweep thread counts 1, 2, 4, ... up to tmax (max %d)\n",
+	   MAXTHREADS);
+    printf("\t-n nops\tOperations per thread\n");
+    printf("\t-r pct\tMeasure only this read percentage\n");
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    static int mixes[] = {100, 99, 90, 50, 0};
+    int nmix = sizeof(mixes) / sizeof(mixes[0]);
+    int maxthreads = 8;
+    int c, m, nthreads, p;
+
+    nops = 100000;
+    while ((c = getopt(argc, argv, "ht:n:r:")) != -1) {
+	switch (c) {
+	case 't':
+	    maxthreads = atoi(optarg);
+	    break;
+	case 'n':
+	    nops = atol(optarg);
+	    break;
+	case 'r':
+	    mixes[0] = atoi(optarg);
+	    nmix = 1;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (maxthreads < 1 || maxthreads > MAXTHREADS)
+	app_error("Error: invalid thread count");
+
+    printf("Millions of operations per second, %ld operations per thread\n",
+	   nops);
+    printf("read%%\tthreads");
+    for (p = 0; p < RW_NPOLICY; p++)
+	printf("\t%s", rwlock_policy_name(p));
+    printf("\n");
+    for (m = 0; m < nmix; m++) {
+	for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+	    printf("%d\t%d", mixes[m], nthreads);
+	    for (p = 0; p < RW_NPOLICY; p++) {
+		printf("\t%.2f", run(p, nthreads, mixes[m]));
+		fflush(stdout);
+	    }
+	    printf("\n");
+	}
+    }
+    exit(0);
+}
@@ -0,0 +1,198 @@
+/*
+ * rwlock.c - Reader-writer locks with selectable scheduling policy
+ *
+ * RW_READER is the weak-reader-priority solution from rw1.c packaged
+ * behind a lock/unlock interface.  RW_WRITER is the companion solution
+ * from Courtois et al, CACM, 1971, in which a waiting writer holds off
+ * newly arriving readers.  RW_FAIR serves readers and writers in ticket
+ * order, so neither side can starve.  RW_SHARDED spreads the reader
+ * count over per-thread cache lines so that readers never write a
+ * shared line unless a writer is active.
+ */
+#include <sched.h>
+#include "csapp.h"
+#include "rwlock.h"
+
+static const char *policy_names[RW_NPOLICY] = {
+    "reader", "writer", "fair", "sharded"
+};
+
+const char *rwlock_policy_name(rw_policy_t policy)
+{
+    return policy_names[policy];
+}
+
+/* Give up the processor while spinning on another thread */
+static void rw_pause(void)
+{
+    sched_yield();
+}
+
+/* Each thread reads through one shard, chosen round robin on first use */
+static volatile int next_shard = 0;
+static __thread int my_shard = -1;
+
+static rw_shard_t *get_shard(rwlock_t *rw)
+{
+    if (my_shard < 0)
+	my_shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED)
+	    % RW_NSHARD;
+    return &rw->shard[my_shard];
+}
+
+/* Initialize lock rw to use the given policy */
+void rwlock_init(rwlock_t *rw, rw_policy_t policy)
+{
+    int rc;
+
+    rw->policy = policy;
+    rw->readcnt = rw->writecnt = 0;
+    Sem_init(&rw->rmutex, 0, 1);
+    Sem_init(&rw->wmutex, 0, 1);
+    Sem_init(&rw->rqueue, 0, 1);
+    Sem_init(&rw->r, 0, 1);
+    Sem_init(&rw->w, 0, 1);
+    rw->next_ticket = rw->now_serving = 0;
+    rw->active_readers = 0;
+    rw->writer = 0;
+    rw->shard = NULL;
+    if (policy == RW_SHARDED) {
+	if ((rc = posix_memalign((void **) &rw->shard, RW_LINE,
+				 RW_NSHARD * sizeof(rw_shard_t))) != 0)
+	    posix_error(rc, "posix_memalign error");
+	memset(rw->shard, 0, RW_NSHARD * sizeof(rw_shard_t));
+    }
+}
+
+/* Clean up lock rw */
+void rwlock_deinit(rwlock_t *rw)
+{
+    if (rw->shard)
+	Free(rw->shard);
+    rw->shard = NULL;
+}
+
+/* $begin rwlock_rdlock */
+void rwlock_rdlock(rwlock_t *rw)
+{
+    unsigned long t;
+    rw_shard_t *s;
+
+    switch (rw->policy) {
+    case RW_READER:
+	P(&rw->rmutex);
+	if (++rw->readcnt == 1) /* First in */
+	    P(&rw->w);
+	V(&rw->rmutex);
+	break;
+    case RW_WRITER:
+	P(&rw->rqueue);          /* Only one reader waits on r */
+	P(&rw->r);               /* Blocked while any writer waits */
+	P(&rw->rmutex);
+	if (++rw->readcnt == 1)  /* First in */
+	    P(&rw->w);
+	V(&rw->rmutex);
+	V(&rw->r);
+	V(&rw->rqueue);
+	break;
+    case RW_FAIR:
+	t = __atomic_fetch_add(&rw->next_ticket, 1, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&rw->now_serving, __ATOMIC_ACQUIRE) != t)
+	    rw_pause();
+	__atomic_fetch_add(&rw->active_readers, 1, __ATOMIC_RELAXED);
+	/* Admit whoever is next in line, so reader runs share the lock */
+	__atomic_store_n(&rw->now_serving, t+1, __ATOMIC_RELEASE);
+	break;
+    case RW_SHARDED:
+	s = get_shard(rw);
+	while (1) {
+	    __atomic_fetch_add(&s->cnt, 1, __ATOMIC_SEQ_CST);
+	    if (!__atomic_load_n(&rw->writer, __ATOMIC_SEQ_CST))
+		break;
+	    /* Writer pending: back out and wait for it to finish */
+	    __atomic_fetch_sub(&s->cnt, 1, __ATOMIC_RELEASE);
+	    while (__atomic_load_n(&rw->writer, __ATOMIC_RELAXED))
+		rw_pause();
+	}
+	break;
+    }
+}
+/* $end rwlock_rdlock */
+
+void rwlock_rdunlock(rwlock_t *rw)
+{
+    switch (rw->policy) {
+    case RW_READER:
+    case RW_WRITER:
+	P(&rw->rmutex);
+	if (--rw->readcnt == 0) /* Last out */
+	    V(&rw->w);
+	V(&rw->rmutex);
+	break;
+    case RW_FAIR:
+	__atomic_fetch_sub(&rw->active_readers, 1, __ATOMIC_RELEASE);
+	break;
+    case RW_SHARDED:
+	__atomic_fetch_sub(&get_shard(rw)->cnt, 1, __ATOMIC_RELEASE);
+	break;
+    }
+}
+
+/* $begin rwlock_wrlock */
+void rwlock_wrlock(rwlock_t *rw)
+{
+    unsigned long t;
+    int i;
+
+    switch (rw->policy) {
+    case RW_READER:
+	P(&rw->w);
+	break;
+    case RW_WRITER:
+	P(&rw->wmutex);
+	if (++rw->writecnt == 1) /* First writer locks out readers */
+	    P(&rw->r);
+	V(&rw->wmutex);
+	P(&rw->w);
+	break;
+    case RW_FAIR:
+	t = __atomic_fetch_add(&rw->next_ticket, 1, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&rw->now_serving, __ATOMIC_ACQUIRE) != t)
+	    rw_pause();
+	/* Drain the readers admitted ahead of us */
+	while (__atomic_load_n(&rw->active_readers, __ATOMIC_ACQUIRE))
+	    rw_pause();
+	break;
+    case RW_SHARDED:
+	P(&rw->w);               /* One writer at a time */
+	__atomic_store_n(&rw->writer, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < RW_NSHARD; i++)
+	    while (__atomic_load_n(&rw->shard[i].cnt, __ATOMIC_SEQ_CST))
+		rw_pause();
+	break;
+    }
+}
+/* $end rwlock_wrlock */
+
+void rwlock_wrunlock(rwlock_t *rw)
+{
+    switch (rw->policy) {
+    case RW_READER:
+	V(&rw->w);
+	break;
+    case RW_WRITER:
+	V(&rw->w);
+	P(&rw->wmutex);
+	if (--rw->writecnt == 0) /* Last writer lets readers back in */
+	    V(&rw->r);
+	V(&rw->wmutex);
+	break;
+    case RW_FAIR:
+	__atomic_fetch_add(&rw->now_serving, 1, __ATOMIC_RELEASE);
+	break;
+    case RW_SHARDED:
+	__atomic_store_n(&rw->writer, 0, __ATOMIC_RELEASE);
+	V(&rw->w);
+	break;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#include "csapp.h"
+
+/*
+ * Reader-writer lock package.  Four policies share one interface:
+ *
+ *   RW_READER   Courtois first solution (readers can starve writers)
+ *   RW_WRITER   Courtois second solution (writers can starve readers)
+ *   RW_FAIR     Ticket lock: FIFO service, consecutive readers share
+ *   RW_SHARDED  Per-thread-sharded reader counts for read-mostly data
+ */
+typedef enum {
+    RW_READER,
+    RW_WRITER,
+    RW_FAIR,
+    RW_SHARDED
+} rw_policy_t;
+
+#define RW_NPOLICY 4
+
+/* Size of a cache line; shard counters are padded out to this */
+#define RW_LINE 64
+/* Number of reader shards in an RW_SHARDED lock */
+#define RW_NSHARD 64
+
+/* One reader counter per cache line */
+typedef struct {
+    volatile long cnt;
+    char pad[RW_LINE - sizeof(long)];
+} rw_shard_t;
+
+/* $begin rwlockt */
+typedef struct {
+    rw_policy_t policy;
+    /* RW_READER and RW_WRITER */
+    int readcnt;              /* Readers in critical section */
+    int writecnt;             /* Writers waiting or writing */
+    sem_t rmutex;             /* Protects readcnt */
+    sem_t wmutex;             /* Protects writecnt */
+    sem_t rqueue;             /* Lets at most one reader queue on r */
+    sem_t r;                  /* Held by writers to hold off new readers */
+    sem_t w;                  /* Held by a writer or by the group of readers */
+    /* RW_FAIR */
+    volatile unsigned long next_ticket;  /* Next ticket handed out */
+    volatile unsigned long now_serving;  /* Ticket allowed to enter */
+    volatile long active_readers;        /* Readers admitted, not yet out */
+    /* RW_SHARDED */
+    volatile int writer;      /* Nonzero while a writer wants the lock */
+    rw_shard_t *shard;        /* RW_NSHARD padded reader counters */
+} rwlock_t;
+/* $end rwlockt */
+
+void rwlock_init(rwlock_t *rw, rw_policy_t policy);
+void rwlock_deinit(rwlock_t *rw);
+void rwlock_rdlock(rwlock_t *rw);
+void rwlock_rdunlock(rwlock_t *rw);
+void rwlock_wrlock(rwlock_t *rw);
+void rwlock_wrunlock(rwlock_t *rw);
+
+/* Printable name of a policy */
+const char *rwlock_policy_name(rw_policy_t policy);
+
+#endif /* __RWLOCK_H__ */
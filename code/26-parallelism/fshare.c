@@ -0,0 +1,202 @@
+/* 
+ * fshare.c - Measure false sharing between per-thread slots.
+ *
+ * Each thread repeatedly updates its own slot, as psum-array does with
+ * psum[myid].  Slots are placed stride bytes apart, from 8 (adjacent
+ * longs, like psum-array) up to several cache lines.  Throughput should
+ * jump once stride reaches the cache line size.  Where the kernel
+ * allows perf_event_open, cache-miss counts are reported as well,
+ * plus an optional raw, CPU-specific event such as HITM loads.  Each
+ * stride is timed through bench_run on the wall clock, since the
+ * threads run on every CPU; counts are from the last sample.
+ */
+/* Needs _GNU_SOURCE for CPU affinity, which csapp.h does not allow */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+
+#define MAXTHREADS 256
+#define MAXSTRIDE 512
+
+/* Global shared variables */
+char *slots;            /* Per-thread slots, stride bytes apart */
+long stride;
+long niters;            /* Updates done by each thread */
+long nthreads;
+long ncpus;
+
+/* Hardware counters, or -1 where unavailable */
+#define NCOUNTERS 3
+int counter_fd[NCOUNTERS] = {-1, -1, -1};
+char *counter_name[NCOUNTERS] = {"cache-miss", "L1D-miss", "raw"};
+long long vals[NCOUNTERS];  /* Counts from the last sample */
+
+static int perf_open(unsigned type, unsigned long long config)
+{
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.type = type;
+    pe.size = sizeof(pe);
+    pe.config = config;
+    pe.disabled = 1;
+    pe.inherit = 1;     /* Count threads created after enable */
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static void open_counters(unsigned long long raw)
+{
+    counter_fd[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counter_fd[1] = perf_open(PERF_TYPE_HW_CACHE,
+			      PERF_COUNT_HW_CACHE_L1D |
+			      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    if (raw)
+	counter_fd[2] = perf_open(PERF_TYPE_RAW, raw);
+}
+
+static void start_counters()
+{
+    int c;
+    for (c = 0; c < NCOUNTERS; c++)
+	if (counter_fd[c] >= 0) {
+	    ioctl(counter_fd[c], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(counter_fd[c], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static void stop_counters(long long *vals)
+{
+    int c;
+    for (c = 0; c < NCOUNTERS; c++) {
+	vals[c] = -1;
+	if (counter_fd[c] >= 0) {
+	    ioctl(counter_fd[c], PERF_EVENT_IOC_DISABLE, 0);
+	    if (read(counter_fd[c], &vals[c], sizeof(long long)) != sizeof(long long))
+		vals[c] = -1;
+	}
+    }
+}
+
+/* Thread routine: update own slot niters times */
+void *update_slot(void *vargp) 
+{
+    long myid = *((long *)vargp);
+    volatile long *slot = (volatile long *) (slots + myid * stride);
+    long i;
+    cpu_set_t set;
+
+    /* Spread threads over CPUs so that slots really bounce */
+    CPU_ZERO(&set);
+    CPU_SET(myid % ncpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    for (i = 0; i < niters; i++)
+	*slot += i;
+    return NULL;
+}
+
+/* Untimed, before each sample: clear the slots and the counters */
+static void reset_slots(void *arg)
+{
+    memset(slots, 0, nthreads * MAXSTRIDE);
+    start_counters();
+}
+
+/* Untimed, after each sample */
+static void read_counters(void *arg)
+{
+    stop_counters(vals);
+}
+
+/* Timed: create the threads and wait for them all */
+static void run_threads(void *arg)
+{
+    long i, myid[MAXTHREADS];
+    pthread_t tid[MAXTHREADS];
+
+    for (i = 0; i < nthreads; i++) {
+	myid[i] = i;
+	if (pthread_create(&tid[i], NULL, update_slot, &myid[i]) != 0) {
+	    fprintf(stderr, "pthread_create error\n");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+}
+
+int main(int argc, char **argv) 
+{
+    long log_niters;
+    unsigned long long raw = 0;
+    int c, json = 0;
+    bench_closure_t b = {run_threads, reset_slots, read_counters, NULL};
+    bench_params_t p = {3, 0.02, 10, 1, BENCH_FLUSH_NONE, BENCH_CLOCK_WALL};
+    bench_result_t r;
+    char name[32];
+
+    /* Get input arguments */
+    if (argc > 1 && !strcmp(argv[1], "-j")) {
+	json = 1;
+	argv++;
+	argc--;
+    }
+    if (argc != 3 && argc != 4) { 
+	printf("Usage: %s [-j] <nthreads> <log_niters> [raw_event]\n", argv[0]);
+	printf("  -j: print each result as JSON, in seconds\n");
+	printf("  raw_event: CPU-specific perf event code in hex, e.g. HITM loads\n");
+	exit(0);
+    }
+    nthreads = atoi(argv[1]);
+    log_niters = atoi(argv[2]);
+    if (argc == 4)
+	raw = strtoull(argv[3], NULL, 16);
+    if (nthreads < 1 || nthreads > MAXTHREADS || log_niters > 40) {
+	printf("Error: invalid arguments\n");
+	exit(0);
+    }
+    niters = 1L << log_niters;
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    slots = aligned_alloc(4096, nthreads * MAXSTRIDE);
+
+    open_counters(raw);
+    if (!json) {
+	if (counter_fd[0] < 0 && counter_fd[1] < 0 && counter_fd[2] < 0)
+	    printf("# perf_event_open unavailable: timing only\n");
+	printf("%7s %7s %10s %10s %17s", "stride", "padding", "ns/update",
+	       "Mupdates/s", "(95% CI)");
+	for (c = 0; c < NCOUNTERS; c++)
+	    if (counter_fd[c] >= 0)
+		printf(" %12s", counter_name[c]);
+	printf("\n");
+    }
+
+    for (stride = sizeof(long); stride <= MAXSTRIDE; stride *= 2) {
+	bench_run(&b, &p, &r);
+	if (json) {
+	    sprintf(name, "fshare stride=%ld", stride);
+	    bench_print_json(stdout, name, &r);
+	    bench_free(&r);
+	    continue;
+	}
+	sprintf(name, "(%.1f-%.1f)", nthreads * niters / r.ci_hi / 1e6,
+		nthreads * niters / r.ci_lo / 1e6);
+	printf("%7ld %7ld %10.3f %10.1f %17s", stride, stride - (long) sizeof(long),
+	       r.median * 1e9 / niters, nthreads * niters / r.median / 1e6, name);
+	for (c = 0; c < NCOUNTERS; c++)
+	    if (counter_fd[c] >= 0)
+		printf(" %12lld", vals[c]);
+	printf("\n");
+	bench_free(&r);
+    }
+    free(slots);
+    exit(0);
+}
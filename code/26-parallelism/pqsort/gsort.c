@@ -0,0 +1,17 @@
+/* Instantiations of type-generic sorts */
+
+#include "csapp.h"
+#include "taskq.h"
+#include "gsort.h"
+
+#define SCALAR_LESS(a, b) ((a) < (b))
+#define KV_LESS(a, b) ((a).key < (b).key)
+
+DEFINE_SORT(gsort_i32, int32_t, SCALAR_LESS)
+DEFINE_SORT(gsort_u32, uint32_t, SCALAR_LESS)
+DEFINE_SORT(gsort_i64, int64_t, SCALAR_LESS)
+DEFINE_SORT(gsort_u64, uint64_t, SCALAR_LESS)
+/* Floating-point arrays must not contain NaNs */
+DEFINE_SORT(gsort_float, float, SCALAR_LESS)
+DEFINE_SORT(gsort_double, double, SCALAR_LESS)
+DEFINE_SORT(gsort_kv, kv_t, KV_LESS)
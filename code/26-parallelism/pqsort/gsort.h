@@ -0,0 +1,182 @@
+/* Type-generic serial and parallel sorting */
+#ifndef __GSORT_H__
+#define __GSORT_H__
+
+#include <stdint.h>
+
+/*
+  DEFINE_SORT(NAME, TYPE, LESS) expands to two functions:
+
+    void NAME_serial(TYPE *base, size_t nele);
+    void NAME_parallel(TYPE *base, size_t nele);
+
+  LESS(a, b) must be a strict weak ordering on TYPE values.  It is
+  expanded in place, so comparisons compile to inline code rather than
+  calls through a function pointer as with qsort.  The serial sort is
+  an introsort (quicksort with ninther pivots, insertion sort for
+  small partitions, heapsort when recursion gets too deep).  The
+  parallel sort partitions serially and hands partitions to the taskq
+  worker pool until they become small.
+
+  Requires csapp.h and taskq.h.
+*/
+
+/* Record type: sort by key, carry payload */
+typedef struct {
+    uint64_t key;
+    uint64_t val;
+} kv_t;
+
+#define DECLARE_SORT(NAME, TYPE)				\
+    void NAME##_serial(TYPE *base, size_t nele);		\
+    void NAME##_parallel(TYPE *base, size_t nele);
+
+DECLARE_SORT(gsort_i32, int32_t)
+DECLARE_SORT(gsort_u32, uint32_t)
+DECLARE_SORT(gsort_i64, int64_t)
+DECLARE_SORT(gsort_u64, uint64_t)
+DECLARE_SORT(gsort_float, float)
+DECLARE_SORT(gsort_double, double)
+DECLARE_SORT(gsort_kv, kv_t)
+
+/* Partitions this small or smaller are finished by insertion sort */
+#define GSORT_INSERTION_MAX 24
+/* Partitions this small or smaller are not split into further tasks */
+#define GSORT_TASK_MIN (1UL << 16)
+
+#define DEFINE_SORT(NAME, TYPE, LESS)					\
+static void NAME##_insertion(TYPE *base, size_t nele) {			\
+    size_t i, j;							\
+    for (i = 1; i < nele; i++) {					\
+	TYPE x = base[i];						\
+	for (j = i; j > 0 && LESS(x, base[j-1]); j--)			\
+	    base[j] = base[j-1];					\
+	base[j] = x;							\
+    }									\
+}									\
+									\
+static void NAME##_sift(TYPE *base, size_t nele, size_t i) {		\
+    TYPE x = base[i];							\
+    size_t c;								\
+    while ((c = 2*i+1) < nele) {					\
+	if (c+1 < nele && LESS(base[c], base[c+1]))			\
+	    c++;							\
+	if (!LESS(x, base[c]))						\
+	    break;							\
+	base[i] = base[c];						\
+	i = c;								\
+    }									\
+    base[i] = x;							\
+}									\
+									\
+static void NAME##_heap(TYPE *base, size_t nele) {			\
+    size_t i;								\
+    for (i = nele/2; i > 0; i--)					\
+	NAME##_sift(base, nele, i-1);					\
+    for (i = nele-1; i > 0; i--) {					\
+	TYPE t = base[0]; base[0] = base[i]; base[i] = t;		\
+	NAME##_sift(base, i, 0);					\
+    }									\
+}									\
+									\
+static TYPE *NAME##_med3(TYPE *a, TYPE *b, TYPE *c) {			\
+    if (!LESS(*b, *a))							\
+	return !LESS(*c, *b) ? b : (!LESS(*c, *a) ? c : a);		\
+    else								\
+	return !LESS(*b, *c) ? b : (!LESS(*a, *c) ? c : a);		\
+}									\
+									\
+/* Partition around ninther.  Returns final index of pivot */		\
+static size_t NAME##_partition(TYPE *base, size_t nele) {		\
+    size_t s = nele/8;							\
+    TYPE *p = NAME##_med3(NAME##_med3(base, base+s, base+2*s),		\
+			  NAME##_med3(base+nele/2-s, base+nele/2,	\
+				      base+nele/2+s),			\
+			  NAME##_med3(base+nele-1-2*s, base+nele-1-s,	\
+				      base+nele-1));			\
+    TYPE pval = *p, t;							\
+    *p = base[nele-1]; base[nele-1] = pval;				\
+    TYPE *left = base, *right = base + nele - 2;			\
+    while (1) {								\
+	while (left <= right && LESS(*left, pval))			\
+	    left++;							\
+	while (left <= right && LESS(pval, *right))			\
+	    right--;							\
+	if (left >= right)						\
+	    break;							\
+	t = *left; *left++ = *right; *right-- = t;			\
+    }									\
+    base[nele-1] = *left; *left = pval;					\
+    return left - base;							\
+}									\
+									\
+static void NAME##_intro(TYPE *base, size_t nele, int depth) {		\
+    while (nele > GSORT_INSERTION_MAX) {				\
+	if (depth-- == 0) {						\
+	    NAME##_heap(base, nele);					\
+	    return;							\
+	}								\
+	size_t m = NAME##_partition(base, nele);			\
+	if (m < nele-m-1) {						\
+	    NAME##_intro(base, m, depth);				\
+	    base += m+1;						\
+	    nele -= m+1;						\
+	} else {							\
+	    NAME##_intro(base+m+1, nele-m-1, depth);			\
+	    nele = m;							\
+	}								\
+    }									\
+    NAME##_insertion(base, nele);					\
+}									\
+									\
+static int NAME##_depth(size_t nele) {					\
+    int lg = 0;								\
+    while ((nele >> lg) > 1)						\
+	lg++;								\
+    return 2*lg;							\
+}									\
+									\
+void NAME##_serial(TYPE *base, size_t nele) {				\
+    NAME##_intro(base, nele, NAME##_depth(nele));			\
+}									\
+									\
+typedef struct {							\
+    TYPE *base;								\
+    size_t nele;							\
+    task_queue_ptr tq;							\
+} NAME##_task_t;							\
+									\
+static void *NAME##_thread(void *vargp) {				\
+    NAME##_task_t *t = (NAME##_task_t *) vargp;				\
+    TYPE *base = t->base;						\
+    size_t nele = t->nele;						\
+    task_queue_ptr tq = t->tq;						\
+    int depth = NAME##_depth(nele);					\
+    free_task_desc(vargp);						\
+    /* Hand off left partitions, keep working on right ones */		\
+    while (nele > GSORT_TASK_MIN && depth-- > 0) {			\
+	size_t m = NAME##_partition(base, nele);			\
+	NAME##_task_t *lt = alloc_task_desc(sizeof(NAME##_task_t));	\
+	lt->base = base;						\
+	lt->nele = m;							\
+	lt->tq = tq;							\
+	spawn_task(tq, NAME##_thread, (void *) lt);			\
+	base += m+1;							\
+	nele -= m+1;							\
+    }									\
+    NAME##_serial(base, nele);						\
+    return NULL;							\
+}									\
+									\
+void NAME##_parallel(TYPE *base, size_t nele) {				\
+    task_queue_ptr tq = new_task_queue();				\
+    NAME##_task_t *t = alloc_task_desc(sizeof(NAME##_task_t));		\
+    t->base = base;							\
+    t->nele = nele;							\
+    t->tq = tq;								\
+    spawn_task(tq, NAME##_thread, (void *) t);				\
+    join_tasks(tq);							\
+    free_task_queue(tq);						\
+}
+
+#endif /* __GSORT_H__ */
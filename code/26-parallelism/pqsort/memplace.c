@@ -0,0 +1,162 @@
+/* Placement of large arrays in memory */
+
+#include <sys/syscall.h>
+#include "csapp.h"
+#include "taskq.h"
+#include "memplace.h"
+
+#define HUGE_PAGE (1UL << 21)
+#define MAXNODE 64
+/* Linux memory policy mode (numaif.h) */
+#define MPOL_INTERLEAVE 3
+
+/* Pages are checked and read in chunks of this size */
+#define PLACE_CHUNK HUGE_PAGE
+
+int numa_node_count() {
+    static int nnode = 0;
+    char path[64];
+    if (nnode == 0) {
+	while (nnode < MAXNODE) {
+	    sprintf(path, "/sys/devices/system/node/node%d", nnode);
+	    if (access(path, F_OK) < 0)
+		break;
+	    nnode++;
+	}
+	if (nnode == 0)
+	    nnode = 1;
+    }
+    return nnode;
+}
+
+/* One chunk of an array, for parallel touching or reading */
+typedef struct {
+    char *start;
+    size_t bytes;
+    volatile long *sink;
+    int worker;
+} place_task_t;
+
+static void *touch_thread(void *vargp) {
+    place_task_t *pt = (place_task_t *) vargp;
+    pin_to_worker_cpu(pt->worker);
+    memset(pt->start, 0, pt->bytes);
+    return NULL;
+}
+
+void *alloc_placed(size_t bytes, place_policy_t policy) {
+    size_t len = (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    /* Over-allocate, then trim to a huge page boundary */
+    char *raw = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+	unix_error("alloc_placed: mmap error");
+    char *p = (char *) (((size_t) raw + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if (p > raw)
+	munmap(raw, p - raw);
+    if (raw + HUGE_PAGE > p)
+	munmap(p + len, raw + HUGE_PAGE - p);
+    madvise(p, len, MADV_HUGEPAGE);
+
+    if (policy == PLACE_INTERLEAVE) {
+	unsigned long mask = 0;
+	int n;
+	for (n = 0; n < numa_node_count(); n++)
+	    mask |= 1UL << n;
+	if (syscall(SYS_mbind, p, len, MPOL_INTERLEAVE, &mask,
+		    8 * sizeof(mask), 0) < 0 && numa_node_count() > 1)
+	    unix_error("alloc_placed: mbind error");
+    } else if (policy == PLACE_FIRST_TOUCH) {
+	/* Same chunking as the block-parallel sorts: nele / nworkers.
+	   Slice i is zeroed by a thread on worker i's CPU, not by a pool
+	   task, since stealing would hand slices to arbitrary workers */
+	int i, nworkers = get_task_workers();
+	size_t chunk = (len / nworkers + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+	place_task_t *pt = Calloc(nworkers, sizeof(place_task_t));
+	pthread_t *tid = Malloc(nworkers * sizeof(pthread_t));
+	for (i = 0; i < nworkers; i++) {
+	    size_t off = i * chunk;
+	    pt[i].start = p + off;
+	    pt[i].bytes = off >= len ? 0 : (len - off < chunk) ? len - off : chunk;
+	    pt[i].worker = i;
+	    Pthread_create(&tid[i], NULL, touch_thread, &pt[i]);
+	}
+	for (i = 0; i < nworkers; i++)
+	    Pthread_join(tid[i], NULL);
+	free(tid);
+	free(pt);
+    }
+    return (void *) p;
+}
+
+void free_placed(void *p, size_t bytes) {
+    size_t len = (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+    munmap(p, len);
+}
+
+static void *read_thread(void *vargp) {
+    place_task_t *pt = (place_task_t *) vargp;
+    long *q = (long *) pt->start;
+    size_t i, n = pt->bytes / sizeof(long);
+    long sum = 0;
+    for (i = 0; i < n; i++)
+	sum += q[i];
+    __atomic_fetch_add(pt->sink, sum, __ATOMIC_RELAXED);
+    free_task_desc(vargp);
+    return NULL;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+void report_placement(void *p, size_t bytes) {
+    size_t nchunk = (bytes + PLACE_CHUNK - 1) / PLACE_CHUNK;
+    int *chunk_node = Malloc(nchunk * sizeof(int));
+    size_t node_chunks[MAXNODE+1];
+    volatile long sink = 0;
+    size_t c;
+    int n, nnode = numa_node_count();
+
+    /* Node holding first page of each chunk.  -1 if unknown */
+    memset(node_chunks, 0, sizeof(node_chunks));
+    for (c = 0; c < nchunk; c++) {
+	void *page = (char *) p + c * PLACE_CHUNK;
+	int status = -1;
+	if (syscall(SYS_move_pages, 0, 1, &page, NULL, &status, 0) < 0 ||
+	    status < 0 || status >= MAXNODE)
+	    status = MAXNODE;
+	chunk_node[c] = status;
+	node_chunks[status]++;
+    }
+    printf("Node\tMB\tGB/s\n");
+    for (n = 0; n <= MAXNODE; n++) {
+	if (node_chunks[n] == 0 || (n >= nnode && n < MAXNODE))
+	    continue;
+	/* Read this node's chunks in parallel */
+	task_queue_ptr tq = new_task_queue();
+	size_t nbytes = 0;
+	double t = now();
+	for (c = 0; c < nchunk; c++) {
+	    if (chunk_node[c] != n)
+		continue;
+	    place_task_t *pt = alloc_task_desc(sizeof(place_task_t));
+	    pt->start = (char *) p + c * PLACE_CHUNK;
+	    pt->bytes = (c == nchunk-1) ? bytes - c * PLACE_CHUNK : PLACE_CHUNK;
+	    pt->sink = &sink;
+	    nbytes += pt->bytes;
+	    spawn_task(tq, read_thread, (void *) pt);
+	}
+	join_tasks(tq);
+	t = now() - t;
+	free_task_queue(tq);
+	if (n == MAXNODE)
+	    printf("?");
+	else
+	    printf("%d", n);
+	printf("\t%.0f\t%.2f\n", nbytes / 1e6, nbytes / t * 1e-9);
+    }
+    free(chunk_node);
+}
@@ -0,0 +1,22 @@
+/* Placement of large arrays in memory */
+
+/* How pages of an array are spread over NUMA nodes */
+typedef enum {
+  PLACE_DEFAULT,     /* Wherever the first writer happens to run */
+  PLACE_FIRST_TOUCH, /* Chunk i zeroed on worker i's CPU.  Exact only when
+			workers are pinned (set_task_affinity); otherwise
+			the scheduler decides where each chunk lands */
+  PLACE_INTERLEAVE   /* Round robin over all nodes */
+} place_policy_t;
+
+/* Allocate bytes aligned to a huge page boundary, with transparent
+   huge pages requested, placed according to policy.  Exits on failure */
+void *alloc_placed(size_t bytes, place_policy_t policy);
+void free_placed(void *p, size_t bytes);
+
+/* Number of NUMA nodes with memory */
+int numa_node_count();
+
+/* Print, for each node, how many pages of [p, p+bytes) it holds and
+   the parallel read bandwidth achieved on those pages */
+void report_placement(void *p, size_t bytes);
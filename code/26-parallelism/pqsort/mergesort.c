@@ -0,0 +1,217 @@
+/* Implementation of parallel multiway mergesort */
+
+#include "csapp.h"
+#include "taskq.h"
+#include "pqsort.h"
+
+/* Smallest run worth handing to a separate task */
+#define MIN_BLOCK (1UL << 14)
+#define MAXRUN 256
+
+/*
+  1. Copy data into scratch in k runs and sort the runs in parallel.
+  2. Split the output into k equal parts.  For each part boundary, find
+     the position in every run such that the positions sum to the
+     boundary and no element left of a position exceeds an element
+     right of one (multisequence selection).
+  3. Each part is a k-way merge from scratch back into base, done
+     independently of the others.
+*/
+
+/* Shared state for one sort */
+typedef struct {
+    data_t *base;
+    data_t *scratch_base;
+    int nrun;
+    size_t run_start[MAXRUN+1];  /* Runs in scratch */
+    /* split[p][r]: start of part p's slice of run r */
+    size_t (*split)[MAXRUN];
+} mergesort_t;
+
+typedef struct {
+    mergesort_t *ms;
+    int index;
+} merge_task_t;
+
+static void *sort_run_thread(void *vargp) {
+    merge_task_t *mt = (merge_task_t *) vargp;
+    mergesort_t *ms = mt->ms;
+    size_t lo = ms->run_start[mt->index];
+    size_t nele = ms->run_start[mt->index+1] - lo;
+    free_task_desc(vargp);
+    memcpy(ms->scratch_base + lo, ms->base + lo, nele * sizeof(data_t));
+    if (use_qsort_lib)
+	qsort_lib(ms->scratch_base + lo, nele, ms->base + lo);
+    else
+	qsort_serial(ms->scratch_base + lo, nele, ms->base + lo);
+    return NULL;
+}
+
+/* Number of elements in sorted run[0..n-1] that are <= v */
+static size_t upper_bound(data_t *run, size_t n, data_t v) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (run[mid] <= v)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* Number of elements in sorted run[0..n-1] that are < v */
+static size_t lower_bound(data_t *run, size_t n, data_t v) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (run[mid] < v)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* Find positions pos[] in each run summing to rank */
+static void select_split(mergesort_t *ms, size_t rank, size_t *pos) {
+    data_t *src = ms->scratch_base;
+    int r;
+    /* Smallest v with at least rank elements <= v */
+    data_t lo = 0, hi = ~(data_t) 0;
+    while (lo < hi) {
+	data_t mid = lo + (hi - lo) / 2;
+	size_t cnt = 0;
+	for (r = 0; r < ms->nrun; r++)
+	    cnt += upper_bound(src + ms->run_start[r],
+			       ms->run_start[r+1] - ms->run_start[r], mid);
+	if (cnt >= rank)
+	    hi = mid;
+	else
+	    lo = mid + 1;
+    }
+    /* Take everything < v, then enough copies of v to reach rank */
+    size_t need = rank;
+    for (r = 0; r < ms->nrun; r++) {
+	pos[r] = lower_bound(src + ms->run_start[r],
+			     ms->run_start[r+1] - ms->run_start[r], lo);
+	need -= pos[r];
+    }
+    for (r = 0; r < ms->nrun && need > 0; r++) {
+	size_t nv = upper_bound(src + ms->run_start[r],
+				ms->run_start[r+1] - ms->run_start[r], lo)
+	    - pos[r];
+	size_t take = nv < need ? nv : need;
+	pos[r] += take;
+	need -= take;
+    }
+    for (r = 0; r < ms->nrun; r++)
+	pos[r] += ms->run_start[r];
+}
+
+/* Heap entry for k-way merge */
+typedef struct {
+    data_t val;
+    int run;
+} heap_ele_t;
+
+static void sift_down(heap_ele_t *heap, int n, int i) {
+    heap_ele_t x = heap[i];
+    while (2*i+1 < n) {
+	int c = 2*i+1;
+	if (c+1 < n && heap[c+1].val < heap[c].val)
+	    c++;
+	if (x.val <= heap[c].val)
+	    break;
+	heap[i] = heap[c];
+	i = c;
+    }
+    heap[i] = x;
+}
+
+static void *merge_part_thread(void *vargp) {
+    merge_task_t *mt = (merge_task_t *) vargp;
+    mergesort_t *ms = mt->ms;
+    int p = mt->index;
+    free_task_desc(vargp);
+    data_t *src = ms->scratch_base;
+    size_t cur[MAXRUN], end[MAXRUN];
+    heap_ele_t heap[MAXRUN];
+    int n = 0, r, i;
+    size_t out = 0;
+    for (r = 0; r < ms->nrun; r++) {
+	cur[r] = ms->split[p][r];
+	end[r] = ms->split[p+1][r];
+	out += cur[r] - ms->run_start[r];
+	if (cur[r] < end[r]) {
+	    heap[n].val = src[cur[r]];
+	    heap[n].run = r;
+	    n++;
+	}
+    }
+    data_t *dest = ms->base + out;
+    for (i = n/2 - 1; i >= 0; i--)
+	sift_down(heap, n, i);
+    while (n > 0) {
+	r = heap[0].run;
+	*dest++ = heap[0].val;
+	if (++cur[r] < end[r])
+	    heap[0].val = src[cur[r]];
+	else
+	    heap[0] = heap[--n];
+	sift_down(heap, n, 0);
+    }
+    return NULL;
+}
+
+/* Run routine once for each index 0..n-1 in parallel */
+static void run_parallel(mergesort_t *ms, int n, thread_routine_t routine) {
+    task_queue_ptr tq = new_task_queue();
+    int i;
+    for (i = 0; i < n; i++) {
+	merge_task_t *mt = alloc_task_desc(sizeof(merge_task_t));
+	mt->ms = ms;
+	mt->index = i;
+	spawn_task(tq, routine, (void *) mt);
+    }
+    join_tasks(tq);
+    free_task_queue(tq);
+}
+
+/* Parallel multiway mergesort */
+void merge_sort(data_t *base, size_t nele, data_t *scratch_base) {
+    int nrun = get_task_workers();
+    int r, p;
+    if (nrun > MAXRUN)
+	nrun = MAXRUN;
+    if (nrun > nele / MIN_BLOCK)
+	nrun = nele / MIN_BLOCK;
+    if (nrun <= 1) {
+	qsort_serial(base, nele, scratch_base);
+	return;
+    }
+
+    mergesort_t *ms = Malloc(sizeof(mergesort_t));
+    ms->base = base;
+    ms->scratch_base = scratch_base;
+    ms->nrun = nrun;
+    size_t npr = nele / nrun;
+    for (r = 0; r <= nrun; r++)
+	ms->run_start[r] = (r < nrun) ? r*npr : nele;
+    run_parallel(ms, nrun, sort_run_thread);
+
+    /* Same number of parts as runs */
+    ms->split = Malloc((nrun+1) * sizeof(*ms->split));
+    for (r = 0; r < nrun; r++) {
+	ms->split[0][r] = ms->run_start[r];
+	ms->split[nrun][r] = ms->run_start[r+1];
+    }
+    for (p = 1; p < nrun; p++)
+	select_split(ms, p*npr, ms->split[p]);
+    if (verbose >= 1)
+	printf("Mergesort: %d runs\n", nrun);
+    run_parallel(ms, nrun, merge_part_thread);
+
+    free(ms->split);
+    free(ms);
+}
@@ -3,16 +3,23 @@
 #include "csapp.h"
 #include "taskq.h"
 #include "pqsort.h"
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 /* Tuning parameters */
 /* Verbosity level */
 int verbose = 0;
 /* Use library quicksort or homebrewed one? */
 int use_qsort_lib = 0;
+/* Partition in parallel through scratch space, rather than in place? */
+int use_partition_copy = 0;
 /* How small do partitions need to be relative to original size
    before using sequential sort & sequential partititoning */
 size_t serial_sort_fraction = 32;
 size_t serial_partition_fraction = 1;
+/* Kernel used for serial partitioning sweeps */
+part_kernel_t partition_kernel = PART_SWEEP;
 
 /* Counting number of comparisons */
 volatile size_t comp_cnt;
@@ -107,9 +114,32 @@ void qsort_lib(data_t *base, size_t nele, data_t *scratch_base) {
     qsort((void *) base, nele, sizeof(data_t), dcomp);
 }
 
-/* Pick pivot for quicksort */
+/* Partition size at which pivot selection switches to ninther */
+#define NINTHER_MIN 128
+
+/* Median of three elements */
+static data_t *med3(data_t *a, data_t *b, data_t *c) {
+    if (LTE(*a, *b))
+	return LTE(*b, *c) ? b : (LTE(*a, *c) ? c : a);
+    else
+	return LTE(*c, *b) ? b : (LTE(*c, *a) ? c : a);
+}
+
+/* Pick pivot for quicksort: median of 3, or for larger partitions
+   Tukey's ninther (median of 3 medians of 3) */
 static data_t *pivot(data_t *base, size_t nele) {
-    return base + nele/2;
+    data_t *l = base;
+    data_t *m = base + nele/2;
+    data_t *r = base + nele - 1;
+    if (nele < 3)
+	return m;
+    if (nele >= NINTHER_MIN) {
+	size_t s = nele/8;
+	l = med3(l, l+s, l+2*s);
+	m = med3(m-s, m, m+s);
+	r = med3(r-2*s, r-s, r);
+    }
+    return med3(l, m, r);
 }
 
 static void swap(data_t *p1, data_t *p2) {
@@ -123,16 +153,20 @@ static void swap(data_t *p1, data_t *p2) {
 static size_t partition_serial(data_t *base, size_t nele);
 static size_t partition_parallel(data_t *base, size_t nele,
 				 data_t *scratch_base, size_t block_size);
+static size_t partition_inplace(data_t *base, size_t nele, size_t block_size);
 
 
 static size_t partition_sweep(data_t *base, size_t nele, data_t pivot);
+static size_t partition_kernel_fn(data_t *base, size_t nele, data_t pval);
 
 static size_t partition(data_t *base, size_t nele, data_t *scratch_base)
 {
     if (nele <= nele_max_partition_serial)
 	return partition_serial(base, nele);
-    else
+    else if (use_partition_copy)
 	return partition_parallel(base, nele, scratch_base, nele_max_partition_serial);
+    else
+	return partition_inplace(base, nele, nele_max_partition_serial);
 }
 
 static size_t partition_serial(data_t *base, size_t nele) {
@@ -142,7 +176,7 @@ static size_t partition_serial(data_t *base, size_t nele) {
     data_t pval = *CHK(p);
     swap(p, base+nele-1);
     /* Do partititoning sweep */
-    size_t pindex = partition_sweep(base, nele-1, pval);
+    size_t pindex = partition_kernel_fn(base, nele-1, pval);
     /* Move pivot to be first element of right partition */
     swap(base + pindex, base+nele-1);
     if (verbose >= 3) {
@@ -157,6 +191,8 @@ static size_t partition_serial(data_t *base, size_t nele) {
 
 /* Partitioning sweep.
    Partitions into left (all elements <= p) and right (all elements >= p).
+   Both pointers stop at elements equal to p, so that runs of equal
+   keys are divided evenly rather than all landing on one side.
    Returns count of number of elements in left partition.
 */
 size_t partition_sweep(data_t *base, size_t nele, data_t pval)
@@ -164,10 +200,10 @@ size_t partition_sweep(data_t *base, size_t nele, data_t pval)
     data_t *left = base;
     data_t *right = base+nele-1;
     while (1) {
-	while (left <= right && LTE(*CHK(left), pval)) {
+	while (left <= right && !LTE(pval, *CHK(left))) {
 	    left++;
 	}
-	while (left <= right && LTE(pval, *CHK(right))) {
+	while (left <= right && !LTE(*CHK(right), pval)) {
 	    right--;
 	}
 	if (left < right) {
@@ -180,6 +216,262 @@ size_t partition_sweep(data_t *base, size_t nele, data_t pval)
     return left - base;
 }
 
+/* Add n to comparison count for kernels that don't go through LTE */
+static void count_comps(size_t n) {
+#ifdef LOGCOMPS
+    pthread_mutex_lock(&count_mutex);
+    comp_cnt += n;
+    pthread_mutex_unlock(&count_mutex);
+#endif
+}
+
+/* Block partitioning (BlockQuicksort, Edelkamp & Weiss).
+   Scan a block at each end, recording offsets of misplaced elements
+   without branching on the comparisons, then swap them in pairs.
+   Elements equal to pivot count as misplaced on both sides, so runs
+   of duplicates get split evenly.  The last < 2 blocks use the sweep.
+*/
+#define PBLOCK 128
+
+static size_t partition_block(data_t *base, size_t nele, data_t pval) {
+    data_t *left = base;
+    data_t *right = base + nele - 1;
+    unsigned char offl[PBLOCK], offr[PBLOCK];
+    size_t numl = 0, numr = 0, startl = 0, startr = 0, num, i;
+    count_comps(nele);
+    while (right - left + 1 > 2*PBLOCK) {
+	if (numl == 0) {
+	    startl = 0;
+	    for (i = 0; i < PBLOCK; i++) {
+		offl[numl] = i;
+		numl += (left[i] >= pval);
+	    }
+	}
+	if (numr == 0) {
+	    startr = 0;
+	    for (i = 0; i < PBLOCK; i++) {
+		offr[numr] = i;
+		numr += (*(right - i) <= pval);
+	    }
+	}
+	num = numl < numr ? numl : numr;
+	for (i = 0; i < num; i++)
+	    swap(left + offl[startl+i], right - offr[startr+i]);
+	numl -= num; numr -= num;
+	startl += num; startr += num;
+	if (numl == 0)
+	    left += PBLOCK;
+	if (numr == 0)
+	    right -= PBLOCK;
+    }
+    /* Everything left of left is <= pval, right of right is >= pval */
+    return (left - base) + partition_sweep(left, right - left + 1, pval);
+}
+
+/* Vectorized partitioning.
+   Hold one vector from each end in registers, which opens a gap at
+   both ends of the array.  Then repeatedly load a vector from
+   whichever end has the smaller gap, split it by pivot, and write the
+   low part at the left gap and the high part at the right gap.
+   Elements equal to pivot go left from one vector and right from the
+   next, so that runs of duplicates get split evenly.
+*/
+
+/* Place single element x into the gap, updating write cursors.
+   Equal elements alternate sides, flipping *eq_left */
+static void place_scalar(data_t *base, data_t x, data_t pval,
+			 size_t *wl, size_t *wr, int *eq_left) {
+    int left = x < pval || (x == pval && *eq_left);
+    if (x == pval)
+	*eq_left = !*eq_left;
+    if (left)
+	base[(*wl)++] = x;
+    else
+	base[--(*wr)] = x;
+}
+
+#ifdef __x86_64__
+/* For each 4-bit mask of lanes above pivot, 32-bit lane permutation
+   moving lanes <= pivot to the bottom and the rest to the top */
+static const int avx2_perm[16][8] __attribute__((aligned(32))) = {
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {2, 3, 4, 5, 6, 7, 0, 1},
+    {0, 1, 4, 5, 6, 7, 2, 3},
+    {4, 5, 6, 7, 0, 1, 2, 3},
+    {0, 1, 2, 3, 6, 7, 4, 5},
+    {2, 3, 6, 7, 0, 1, 4, 5},
+    {0, 1, 6, 7, 2, 3, 4, 5},
+    {6, 7, 0, 1, 2, 3, 4, 5},
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {2, 3, 4, 5, 0, 1, 6, 7},
+    {0, 1, 4, 5, 2, 3, 6, 7},
+    {4, 5, 0, 1, 2, 3, 6, 7},
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {2, 3, 0, 1, 4, 5, 6, 7},
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {0, 1, 2, 3, 4, 5, 6, 7},
+};
+
+#define V2 4
+
+__attribute__((target("avx2")))
+static size_t partition_avx2(data_t *base, size_t nele, data_t pval) {
+    if (nele < 2*V2)
+	return partition_sweep(base, nele, pval);
+    count_comps(nele);
+    /* No unsigned compare in AVX2: flip sign bits and compare signed */
+    __m256i sign = _mm256_set1_epi64x(1LL << 63);
+    __m256i pv = _mm256_xor_si256(_mm256_set1_epi64x(pval), sign);
+    data_t saved[2*V2];
+    memcpy(saved, base, V2 * sizeof(data_t));
+    memcpy(saved + V2, base + nele - V2, V2 * sizeof(data_t));
+    size_t wl = 0, wr = nele, rl = V2, rr = nele - V2;
+    int eq_left = 0;
+    while (rr - rl >= V2) {
+	__m256i x;
+	if (rl - wl <= wr - rr) {
+	    x = _mm256_loadu_si256((__m256i *) (base + rl));
+	    rl += V2;
+	} else {
+	    rr -= V2;
+	    x = _mm256_loadu_si256((__m256i *) (base + rr));
+	}
+	/* Right side takes lanes > pivot, or >= pivot on alternate
+	   vectors (not < pivot) */
+	__m256i xs = _mm256_xor_si256(x, sign);
+	__m256i right = eq_left ? _mm256_cmpgt_epi64(xs, pv)
+	    : _mm256_xor_si256(_mm256_cmpgt_epi64(pv, xs),
+			       _mm256_set1_epi64x(-1));
+	int mask = _mm256_movemask_pd(_mm256_castsi256_pd(right));
+	eq_left = !eq_left;
+	int nright = __builtin_popcount(mask);
+	__m256i y = _mm256_permutevar8x32_epi32(x,
+	    _mm256_load_si256((__m256i *) avx2_perm[mask]));
+	/* Both gaps hold at least a full vector, so store all lanes */
+	_mm256_storeu_si256((__m256i *) (base + wl), y);
+	_mm256_storeu_si256((__m256i *) (base + wr - V2), y);
+	wl += V2 - nright;
+	wr -= nright;
+    }
+    while (rl < rr) {
+	data_t x = (rl - wl <= wr - rr) ? base[rl++] : base[--rr];
+	place_scalar(base, x, pval, &wl, &wr, &eq_left);
+    }
+    int i;
+    for (i = 0; i < 2*V2; i++)
+	place_scalar(base, saved[i], pval, &wl, &wr, &eq_left);
+    return wl;
+}
+
+#define V512 8
+
+__attribute__((target("avx512f")))
+static size_t partition_avx512(data_t *base, size_t nele, data_t pval) {
+    if (nele < 2*V512)
+	return partition_sweep(base, nele, pval);
+    count_comps(nele);
+    __m512i pv = _mm512_set1_epi64(pval);
+    __m512i save_l = _mm512_loadu_si512(base);
+    __m512i save_r = _mm512_loadu_si512(base + nele - V512);
+    size_t wl = 0, wr = nele, rl = V512, rr = nele - V512;
+    int eq_left = 0;
+    __m512i x;
+    while (rr - rl >= V512) {
+	if (rl - wl <= wr - rr) {
+	    x = _mm512_loadu_si512(base + rl);
+	    rl += V512;
+	} else {
+	    rr -= V512;
+	    x = _mm512_loadu_si512(base + rr);
+	}
+	/* Left side takes lanes < pivot, or <= pivot on alternate
+	   vectors */
+	__mmask8 le = eq_left ? _mm512_cmple_epu64_mask(x, pv)
+	    : _mm512_cmplt_epu64_mask(x, pv);
+	int nleft = __builtin_popcount(le);
+	eq_left = !eq_left;
+	_mm512_mask_compressstoreu_epi64(base + wl, le, x);
+	wl += nleft;
+	wr -= V512 - nleft;
+	_mm512_mask_compressstoreu_epi64(base + wr, ~le, x);
+    }
+    while (rl < rr) {
+	data_t y = (rl - wl <= wr - rr) ? base[rl++] : base[--rr];
+	place_scalar(base, y, pval, &wl, &wr, &eq_left);
+    }
+    /* Compress stores write only selected lanes, so the gap can be
+       filled exactly */
+    int k;
+    for (k = 0; k < 2; k++) {
+	x = k ? save_r : save_l;
+	/* Left side takes lanes < pivot, or <= pivot on alternate
+	   vectors */
+	__mmask8 le = eq_left ? _mm512_cmple_epu64_mask(x, pv)
+	    : _mm512_cmplt_epu64_mask(x, pv);
+	int nleft = __builtin_popcount(le);
+	eq_left = !eq_left;
+	_mm512_mask_compressstoreu_epi64(base + wl, le, x);
+	wl += nleft;
+	wr -= V512 - nleft;
+	_mm512_mask_compressstoreu_epi64(base + wr, ~le, x);
+    }
+    return wl;
+}
+#endif /* __x86_64__ */
+
+static const char *kernel_names[] = {"sweep", "block", "avx2", "avx512"};
+
+/* Select kernel by name.  "simd" picks the widest one the CPU has.
+   Return 0 if name unknown or kernel unsupported on this CPU */
+int select_partition_kernel(char *name) {
+    int k;
+    if (strcmp(name, "simd") == 0) {
+#ifdef __x86_64__
+	if (__builtin_cpu_supports("avx512f"))
+	    name = "avx512";
+	else if (__builtin_cpu_supports("avx2"))
+	    name = "avx2";
+	else
+#endif
+	    name = "block";
+    }
+    for (k = PART_SWEEP; k <= PART_AVX512; k++) {
+	if (strcmp(name, kernel_names[k]) == 0) {
+#ifdef __x86_64__
+	    if ((k == PART_AVX2 && !__builtin_cpu_supports("avx2")) ||
+		(k == PART_AVX512 && !__builtin_cpu_supports("avx512f")))
+		return 0;
+#else
+	    if (k == PART_AVX2 || k == PART_AVX512)
+		return 0;
+#endif
+	    partition_kernel = k;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+const char *partition_kernel_name() {
+    return kernel_names[partition_kernel];
+}
+
+/* Dispatch to selected partitioning kernel */
+static size_t partition_kernel_fn(data_t *base, size_t nele, data_t pval) {
+    switch (partition_kernel) {
+    case PART_BLOCK:
+	return partition_block(base, nele, pval);
+#ifdef __x86_64__
+    case PART_AVX2:
+	return partition_avx2(base, nele, pval);
+    case PART_AVX512:
+	return partition_avx512(base, nele, pval);
+#endif
+    default:
+	return partition_sweep(base, nele, pval);
+    }
+}
+
 /* Parallel copy.  Needed as part of parallel partitioning */
 /* Have structure that defines copying task */
 typedef struct {
@@ -189,7 +481,7 @@ typedef struct {
 } copy_task_t, *copy_task_ptr;
 
 void *new_copy_task(data_t *src, data_t *dest, size_t nele) {
-    copy_task_ptr p = (copy_task_ptr) Malloc(sizeof(copy_task_t));
+    copy_task_ptr p = (copy_task_ptr) alloc_task_desc(sizeof(copy_task_t));
     p->src = src;
     p->dest = dest;
     p->nele = nele;
@@ -202,7 +494,7 @@ void *copy_thread(void *vargp) {
     data_t *src = p->src;
     data_t *dest = p->dest;
     size_t nele = p->nele;
-    free(vargp);
+    free_task_desc(vargp);
     if (verbose >= 3) {
 	printf("Copy thread.  %lu elements from %lu to %lu\n",
 	       (printi_t) nele,
@@ -273,7 +565,7 @@ typedef struct {
 
 void *new_partition_task(size_t nele, size_t src_index, partition_t *par)
 {
-    partition_task_t *pt = Malloc(sizeof(partition_task_t));
+    partition_task_t *pt = alloc_task_desc(sizeof(partition_task_t));
     pt->nele = nele;
     pt->src_index = src_index;
     pt->par = par;
@@ -286,10 +578,10 @@ static void *partition_thread(void *vargp) {
     size_t nele = pt->nele;
     size_t src_index = pt->src_index;
     partition_t *par = pt->par;
-    free(vargp);
+    free_task_desc(vargp);
     /* Do sequential partitioning */
-    size_t nleft = partition_sweep(par->scratch_base + src_index, nele,
-				   par->pval);
+    size_t nleft = partition_kernel_fn(par->scratch_base + src_index, nele,
+				       par->pval);
     size_t nright = nele - nleft;
     /* Get destination positions */
     pthread_mutex_lock(&par->mutex);
@@ -361,25 +653,374 @@ static size_t partition_parallel(data_t *base, size_t nele,
     return left_size;
 }
 
+/* In-place parallel partitioning
+   1. Choose global pivot p and break into k blocks.  Partition each
+      block in place by p, in parallel.  The left side of the result
+      then has size L = sum of the blocks' left sizes.
+   2. Elements >= p that ended up in [0,L) and elements <= p in [L,n)
+      are equal in number.  Number each set in address order and swap
+      the i'th element of one with the i'th of the other, in parallel
+      chunks of ranks.
+   Nothing passes through scratch space and no locking is needed.
+*/
+
+typedef struct {
+    data_t *base;
+    data_t pval;
+    int nblock;
+    size_t *bstart;     /* Block boundaries, nblock+1 entries */
+    size_t *bleft;      /* Left size of each block after step 1 */
+    /* Misplaced range in each block, and rank of its first element */
+    size_t *hi_start;   /* Elements >= p inside [0,L) */
+    size_t *hi_rank;
+    size_t *lo_start;   /* Elements <= p inside [L,n) */
+    size_t *lo_rank;
+} ip_partition_t;
+
+/* Block index for step 1, rank range [lo,hi) for step 2 */
+typedef struct {
+    ip_partition_t *ip;
+    size_t lo;
+    size_t hi;
+} ip_task_t;
+
+static void spawn_ip_task(task_queue_ptr tq, thread_routine_t routine,
+			  ip_partition_t *ip, size_t lo, size_t hi) {
+    ip_task_t *t = alloc_task_desc(sizeof(ip_task_t));
+    t->ip = ip;
+    t->lo = lo;
+    t->hi = hi;
+    spawn_task(tq, routine, (void *) t);
+}
+
+static void *ip_block_thread(void *vargp) {
+    ip_task_t *t = (ip_task_t *) vargp;
+    ip_partition_t *ip = t->ip;
+    size_t b = t->lo;
+    free_task_desc(vargp);
+    size_t start = ip->bstart[b];
+    ip->bleft[b] = partition_kernel_fn(ip->base + start,
+				       ip->bstart[b+1] - start, ip->pval);
+    return NULL;
+}
+
+static void *ip_swap_thread(void *vargp) {
+    ip_task_t *t = (ip_task_t *) vargp;
+    ip_partition_t *ip = t->ip;
+    size_t r = t->lo;
+    size_t rend = t->hi;
+    int hb = 0, lb = 0;
+    free_task_desc(vargp);
+    while (r < rend) {
+	/* Find ranges holding rank r, skipping empty ones */
+	while (ip->hi_rank[hb+1] <= r)
+	    hb++;
+	while (ip->lo_rank[lb+1] <= r)
+	    lb++;
+	size_t len = rend - r;
+	if (ip->hi_rank[hb+1] - r < len)
+	    len = ip->hi_rank[hb+1] - r;
+	if (ip->lo_rank[lb+1] - r < len)
+	    len = ip->lo_rank[lb+1] - r;
+	data_t *h = ip->base + ip->hi_start[hb] + (r - ip->hi_rank[hb]);
+	data_t *l = ip->base + ip->lo_start[lb] + (r - ip->lo_rank[lb]);
+	size_t i;
+	for (i = 0; i < len; i++)
+	    swap(h+i, l+i);
+	r += len;
+    }
+    return NULL;
+}
+
+static size_t partition_inplace(data_t *base, size_t nele, size_t block_size)
+{
+    /* Select pivot */
+    data_t *p = pivot(base, nele);
+    data_t pval = *CHK(p);
+    /* Move to right of array and partition the rest */
+    swap(p, base+nele-1);
+    nele--;
+    int nblock = (nele + block_size - 1) / block_size;
+    size_t npb = nele / nblock;
+    int b;
+    ip_partition_t ip;
+    ip.base = base;
+    ip.pval = pval;
+    ip.nblock = nblock;
+    size_t *arrays = Malloc(6 * (nblock+1) * sizeof(size_t));
+    ip.bstart = arrays;
+    ip.bleft = arrays + (nblock+1);
+    ip.hi_start = arrays + 2*(nblock+1);
+    ip.hi_rank = arrays + 3*(nblock+1);
+    ip.lo_start = arrays + 4*(nblock+1);
+    ip.lo_rank = arrays + 5*(nblock+1);
+    for (b = 0; b <= nblock; b++)
+	ip.bstart[b] = (b < nblock) ? b*npb : nele;
+
+    /* Step 1: partition blocks */
+    task_queue_ptr tq = new_task_queue();
+    for (b = 0; b < nblock; b++)
+	spawn_ip_task(tq, ip_block_thread, &ip, b, 0);
+    join_tasks(tq);
+
+    /* Locate misplaced ranges */
+    size_t left_size = 0;
+    for (b = 0; b < nblock; b++)
+	left_size += ip.bleft[b];
+    size_t nhi = 0, nlo = 0;
+    for (b = 0; b < nblock; b++) {
+	size_t mid = ip.bstart[b] + ip.bleft[b];
+	size_t end = ip.bstart[b+1] < left_size ? ip.bstart[b+1] : left_size;
+	ip.hi_start[b] = mid;
+	ip.hi_rank[b] = nhi;
+	nhi += (end > mid) ? end - mid : 0;
+	size_t start = ip.bstart[b] > left_size ? ip.bstart[b] : left_size;
+	ip.lo_start[b] = start;
+	ip.lo_rank[b] = nlo;
+	nlo += (mid > start) ? mid - start : 0;
+    }
+    ip.hi_rank[nblock] = nhi;
+    ip.lo_rank[nblock] = nlo;
+
+    /* Step 2: exchange misplaced elements */
+    if (nhi > 0) {
+	size_t chunk = (nhi + nblock - 1) / nblock;
+	size_t r;
+	for (r = 0; r < nhi; r += chunk)
+	    spawn_ip_task(tq, ip_swap_thread, &ip, r,
+			  r + chunk < nhi ? r + chunk : nhi);
+	join_tasks(tq);
+    }
+    free_task_queue(tq);
+    free(arrays);
+    /* Swap pivot back */
+    swap(base+left_size, base+nele);
+    if (verbose >= 2) {
+	printf("In-place partitioning.  Pivot = %lu. [%lu,%lu,%lu] in %d blocks, %lu exchanged\n",
+	       (printi_t) pval,
+	       (printi_t) global_index(base),
+	       (printi_t) global_index(base+left_size),
+	       (printi_t) global_index(base+nele),
+	       nblock, (printi_t) nhi);
+    }
+    if (verbose >= 3) {
+	printf("Partitioned results: ");
+	show_data(base, nele+1);
+    }
+    return left_size;
+}
+
+/* Partitions this small or smaller are finished by insertion sort */
+#define INSERTION_MAX 24
+
+static void insertion_sort(data_t *base, size_t nele) {
+    size_t i, j;
+    for (i = 1; i < nele; i++) {
+	data_t x = base[i];
+	for (j = i; j > 0 && !LTE(base[j-1], x); j--)
+	    base[j] = base[j-1];
+	base[j] = x;
+    }
+}
+
+/* Restore heap property below node i of max-heap base[0..nele-1] */
+static void sift_down(data_t *base, size_t nele, size_t i) {
+    data_t x = base[i];
+    size_t c;
+    while ((c = 2*i+1) < nele) {
+	if (c+1 < nele && LTE(base[c], base[c+1]))
+	    c++;
+	if (LTE(base[c], x))
+	    break;
+	base[i] = base[c];
+	i = c;
+    }
+    base[i] = x;
+}
+
+/* Fallback when quicksort recursion gets too deep */
+static void heap_sort(data_t *base, size_t nele) {
+    size_t i;
+    if (verbose >= 2) {
+	size_t l = global_index(base);
+	size_t r = global_index(base + nele - 1);
+	printf("Heapsort fallback.  [%lu,%lu]\n", (printi_t) l, (printi_t) r);
+    }
+    for (i = nele/2; i > 0; i--)
+	sift_down(base, nele, i-1);
+    for (i = nele-1; i > 0; i--) {
+	swap(base, base+i);
+	sift_down(base, i, 0);
+    }
+}
+
+/* Quicksort with depth limit (introsort).  Recurses on the smaller
+   partition and loops on the larger, so stack depth is O(log n) */
+static void introsort(data_t *base, size_t nele, int depth_limit) {
+    while (nele > INSERTION_MAX) {
+	if (depth_limit-- == 0) {
+	    heap_sort(base, nele);
+	    return;
+	}
+	size_t m = partition_serial(base, nele);
+	if (m < nele-m-1) {
+	    introsort(base, m, depth_limit);
+	    base += m+1;
+	    nele -= m+1;
+	} else {
+	    introsort(base+m+1, nele-m-1, depth_limit);
+	    nele = m;
+	}
+    }
+    insertion_sort(base, nele);
+}
+
+/*
+  Adversarial input for qsort_serial (McIlroy, "A Killer Adversary for
+  Quicksort").  Runs a replica of qsort_serial, with the sweep kernel,
+  on item numbers.  Items start out as "gas", with a value above all
+  others.  When two gas items are compared, one is frozen at the next
+  smallest value, preferring to freeze the item most recently compared
+  against a frozen one, which is likely the pivot.  Pivots thus end up
+  small, and partitions lopsided.  The replica must make the same
+  comparisons in the same order as pivot, partition_serial,
+  partition_sweep, insertion_sort and heap_sort above.
+*/
+static data_t *aq_val;
+static data_t aq_gas, aq_nsolid, aq_candidate;
+
+static int aq_lte(data_t x, data_t y) {
+    if (aq_val[x] == aq_gas && aq_val[y] == aq_gas) {
+	if (x == aq_candidate)
+	    aq_val[x] = aq_nsolid++;
+	else
+	    aq_val[y] = aq_nsolid++;
+    }
+    if (aq_val[x] == aq_gas)
+	aq_candidate = x;
+    else if (aq_val[y] == aq_gas)
+	aq_candidate = y;
+    return aq_val[x] <= aq_val[y];
+}
+
+static data_t *aq_med3(data_t *a, data_t *b, data_t *c) {
+    if (aq_lte(*a, *b))
+	return aq_lte(*b, *c) ? b : (aq_lte(*a, *c) ? c : a);
+    else
+	return aq_lte(*c, *b) ? b : (aq_lte(*c, *a) ? c : a);
+}
+
+static data_t *aq_pivot(data_t *base, size_t nele) {
+    data_t *l = base;
+    data_t *m = base + nele/2;
+    data_t *r = base + nele - 1;
+    if (nele < 3)
+	return m;
+    if (nele >= NINTHER_MIN) {
+	size_t s = nele/8;
+	l = aq_med3(l, l+s, l+2*s);
+	m = aq_med3(m-s, m, m+s);
+	r = aq_med3(r-2*s, r-s, r);
+    }
+    return aq_med3(l, m, r);
+}
+
+static size_t aq_partition(data_t *base, size_t nele) {
+    data_t *p = aq_pivot(base, nele);
+    data_t pval = *p;
+    swap(p, base+nele-1);
+    data_t *left = base;
+    data_t *right = base+nele-2;
+    while (1) {
+	while (left <= right && !aq_lte(pval, *left))
+	    left++;
+	while (left <= right && !aq_lte(*right, pval))
+	    right--;
+	if (left < right) {
+	    swap(left, right);
+	    left++;
+	    right--;
+	} else
+	    break;
+    }
+    size_t pindex = left - base;
+    swap(base + pindex, base+nele-1);
+    return pindex;
+}
+
+static void aq_sift_down(data_t *base, size_t nele, size_t i) {
+    data_t x = base[i];
+    size_t c;
+    while ((c = 2*i+1) < nele) {
+	if (c+1 < nele && aq_lte(base[c], base[c+1]))
+	    c++;
+	if (aq_lte(base[c], x))
+	    break;
+	base[i] = base[c];
+	i = c;
+    }
+    base[i] = x;
+}
+
+static void aq_introsort(data_t *base, size_t nele, int depth_limit) {
+    size_t i, j;
+    while (nele > INSERTION_MAX) {
+	if (depth_limit-- == 0) {
+	    for (i = nele/2; i > 0; i--)
+		aq_sift_down(base, nele, i-1);
+	    for (i = nele-1; i > 0; i--) {
+		swap(base, base+i);
+		aq_sift_down(base, i, 0);
+	    }
+	    return;
+	}
+	size_t m = aq_partition(base, nele);
+	if (m < nele-m-1) {
+	    aq_introsort(base, m, depth_limit);
+	    base += m+1;
+	    nele -= m+1;
+	} else {
+	    aq_introsort(base+m+1, nele-m-1, depth_limit);
+	    nele = m;
+	}
+    }
+    for (i = 1; i < nele; i++) {
+	data_t x = base[i];
+	for (j = i; j > 0 && !aq_lte(base[j-1], x); j--)
+	    base[j] = base[j-1];
+	base[j] = x;
+    }
+}
+
+void qsort_killer(data_t *dest, size_t nele) {
+    data_t *items = Malloc(nele * sizeof(data_t));
+    size_t i;
+    int log_nele = 0;
+    for (i = 0; i < nele; i++) {
+	items[i] = i;
+	dest[i] = nele;
+    }
+    aq_val = dest;
+    aq_gas = nele;
+    aq_nsolid = 0;
+    aq_candidate = 0;
+    while ((nele >> log_nele) > 1)
+	log_nele++;
+    aq_introsort(items, nele, 2 * log_nele);
+    free(items);
+}
+
 void qsort_serial(data_t *base, size_t nele,
 		  data_t *scratch_base) {
+    int log_nele = 0;
     if (verbose >= 3) {
 	size_t l = global_index(base);
 	size_t r = global_index(base + nele - 1);
 	printf("Qsort_serial.  [%lu,%lu]\n", (printi_t) l, (printi_t) r);
     }
-    if (nele <= 1)
-	return;
-    if (nele == 2) {
-	if (base[0] > base[1])
-	    swap(base, base+1);
-	return;
-    }
-    size_t m = partition_serial(base, nele);
-    if (m > 1)
-	qsort_serial(base, m, scratch_base);
-    if (nele-1 > m+1)
-	qsort_serial(base+m+1, nele-m-1, scratch_base+m+1);
+    while ((nele >> log_nele) > 1)
+	log_nele++;
+    introsort(base, nele, 2 * log_nele);
 }
 
 /* For threaded sorting, have structure that defines sorting task */
@@ -419,7 +1060,7 @@ static void init_task(size_t nele) {
 /* Add a new task to the list.  Returns position in task list */
 static sort_task_ptr new_task(data_t *base, size_t nele,
 			      data_t *scratch_base, task_queue_ptr tq) {
-    sort_task_ptr t = Malloc(sizeof(sort_task_t));
+    sort_task_ptr t = alloc_task_desc(sizeof(sort_task_t));
     t->base = base;
     t->nele = nele;
     t->scratch_base = scratch_base;
@@ -442,7 +1083,7 @@ static void *sort_thread(void *vargp) {
     size_t nele = t->nele;
     data_t *scratch_base = t->scratch_base;
     task_queue_ptr tq = t->tq;
-    free(vargp);
+    free_task_desc(vargp);
     if (verbose >= 2) {
 	size_t l = global_index(base);
 	size_t r = global_index(base + nele-1);
@@ -19,6 +19,21 @@ extern size_t serial_sort_fraction;
 extern size_t serial_partition_fraction;
 /* For sequential sort: use library quicksort or homebrewed one? */
 extern int use_qsort_lib;
+/* For parallel partitioning: copy through scratch space rather than
+   partitioning in place? */
+extern int use_partition_copy;
+/* Kernel for serial partitioning sweeps */
+typedef enum {
+    PART_SWEEP,    /* Hoare two-pointer sweep */
+    PART_BLOCK,    /* Branchless block partitioning */
+    PART_AVX2,     /* Vectorized, 4 elements at a time */
+    PART_AVX512    /* Vectorized with compress-store, 8 at a time */
+} part_kernel_t;
+extern part_kernel_t partition_kernel;
+/* Select kernel by name: sweep, block, avx2, avx512 or simd (widest
+   available).  Returns 0 if unknown or not supported by this CPU */
+int select_partition_kernel(char *name);
+const char *partition_kernel_name();
 /* Counter that gets incremented for every comparison */
 extern volatile size_t comp_cnt;
 
@@ -31,5 +46,18 @@ void qsort_lib(data_t *base, size_t nele, data_t *scratch_base);
 /* Serial quicksort */
 void qsort_serial(data_t *base, size_t nele, data_t *scratch_base);
 
+/* Fill dest with an input that drives qsort_serial (sweep kernel)
+   into its worst case (McIlroy's antiqsort) */
+void qsort_killer(data_t *dest, size_t nele);
+
 /* Many-threaded quicksort */
 void tqsort(data_t *base, size_t nele, data_t *scratch_base);
+
+/* Parallel LSD radix sort.  Uses scratch_base as second buffer */
+void radix_sort(data_t *base, size_t nele, data_t *scratch_base);
+
+/* Parallel samplesort.  Scatters buckets into scratch_base */
+void sample_sort(data_t *base, size_t nele, data_t *scratch_base);
+
+/* Parallel multiway mergesort.  Sorts runs in scratch_base */
+void merge_sort(data_t *base, size_t nele, data_t *scratch_base);
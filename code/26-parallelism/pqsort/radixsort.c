@@ -0,0 +1,140 @@
+/* Implementation of parallel LSD radix sort */
+
+#include "csapp.h"
+#include "taskq.h"
+#include "pqsort.h"
+
+/* Bits sorted per pass */
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX - 1)
+#define NPASS ((int) (8 * sizeof(data_t) + RADIX_BITS - 1) / RADIX_BITS)
+/* Elements held in each write-combining buffer (one cache line) */
+#define WC_NELE (64 / sizeof(data_t))
+/* Smallest block worth handing to a separate task */
+#define MIN_BLOCK (1UL << 14)
+
+/*
+  Each pass:
+  1. Every block task builds a histogram of the current digit.
+  2. Prefix sums over (digit, block) give each block the position
+     where its first element with each digit value goes.
+  3. Every block task scatters its elements to those positions.
+  Scatter stages elements in cache-line sized buffers per digit.  The
+  first flush for a digit is cut short at the next line boundary of
+  the destination, so that every later flush writes one full line.
+*/
+
+/* Work done by one task */
+typedef struct {
+    data_t *src;
+    data_t *dest;
+    size_t nele;
+    int shift;
+    size_t count[RADIX];   /* Histogram, then scatter positions */
+} radix_block_t;
+
+static void *radix_hist_thread(void *vargp) {
+    radix_block_t *b = (radix_block_t *) vargp;
+    data_t *src = b->src;
+    int shift = b->shift;
+    size_t i;
+    memset(b->count, 0, sizeof(b->count));
+    for (i = 0; i < b->nele; i++)
+	b->count[(src[i] >> shift) & RADIX_MASK]++;
+    return NULL;
+}
+
+static void *radix_scatter_thread(void *vargp) {
+    radix_block_t *b = (radix_block_t *) vargp;
+    data_t *src = b->src;
+    data_t *dest = b->dest;
+    size_t *pos = b->count;
+    int shift = b->shift;
+    data_t buf[RADIX][WC_NELE] __attribute__((aligned(64)));
+    unsigned fill[RADIX], lim[RADIX];
+    size_t i;
+    int d;
+    memset(fill, 0, sizeof(fill));
+    /* Elements up to the first line boundary at each digit's position */
+    for (d = 0; d < RADIX; d++)
+	lim[d] = WC_NELE - ((size_t) (dest + pos[d]) % 64) / sizeof(data_t);
+    for (i = 0; i < b->nele; i++) {
+	data_t x = src[i];
+	d = (x >> shift) & RADIX_MASK;
+	buf[d][fill[d]++] = x;
+	if (fill[d] == lim[d]) {
+	    memcpy(dest + pos[d], buf[d], fill[d] * sizeof(data_t));
+	    pos[d] += fill[d];
+	    fill[d] = 0;
+	    lim[d] = WC_NELE;
+	}
+    }
+    for (d = 0; d < RADIX; d++)
+	memcpy(dest + pos[d], buf[d], fill[d] * sizeof(data_t));
+    return NULL;
+}
+
+/* Run routine on every block in parallel */
+static void run_blocks(radix_block_t *blocks, int nblock,
+		       thread_routine_t routine) {
+    task_queue_ptr tq = new_task_queue();
+    int b;
+    for (b = 0; b < nblock; b++)
+	spawn_task(tq, routine, (void *) &blocks[b]);
+    join_tasks(tq);
+    free_task_queue(tq);
+}
+
+/* Parallel radix sort */
+void radix_sort(data_t *base, size_t nele, data_t *scratch_base) {
+    int nblock = get_task_workers();
+    if (nblock > nele / MIN_BLOCK)
+	nblock = nele / MIN_BLOCK;
+    if (nblock < 1)
+	nblock = 1;
+    size_t npb = nele / nblock;
+    radix_block_t *blocks = Malloc(nblock * sizeof(radix_block_t));
+    data_t *src = base;
+    data_t *dest = scratch_base;
+    data_t all_or = 0, all_and = ~(data_t) 0;
+    size_t i;
+    int b, pass, d;
+
+    /* Digits on which all keys agree need no pass */
+    for (i = 0; i < nele; i++) {
+	all_or |= base[i];
+	all_and &= base[i];
+    }
+    for (pass = 0; pass < NPASS; pass++) {
+	int shift = pass * RADIX_BITS;
+	if ((((all_or ^ all_and) >> shift) & RADIX_MASK) == 0)
+	    continue;
+	for (b = 0; b < nblock; b++) {
+	    blocks[b].src = src + b*npb;
+	    blocks[b].dest = dest;
+	    blocks[b].nele = (b < nblock-1) ? npb : nele - b*npb;
+	    blocks[b].shift = shift;
+	}
+	run_blocks(blocks, nblock, radix_hist_thread);
+	/* Exclusive prefix sum, digit-major so each block's run of a
+	   digit follows the previous block's run of the same digit */
+	size_t sum = 0;
+	for (d = 0; d < RADIX; d++)
+	    for (b = 0; b < nblock; b++) {
+		size_t c = blocks[b].count[d];
+		blocks[b].count[d] = sum;
+		sum += c;
+	    }
+	run_blocks(blocks, nblock, radix_scatter_thread);
+	if (verbose >= 2)
+	    printf("Radix pass %d: %d blocks\n", pass, nblock);
+	data_t *tmp = src;
+	src = dest;
+	dest = tmp;
+    }
+    /* Odd number of passes leaves result in scratch */
+    if (src != base)
+	memcpy(base, src, nele * sizeof(data_t));
+    free(blocks);
+}
@@ -1,20 +1,12 @@
-#include <sys/time.h>
+#include "clock.h"
 
 static double start_time;
-static struct timezone zone; 
 
 void start_timer()
 {
-  zone.tz_minuteswest = 0;
-  zone.tz_dsttime = 0;
-  struct timeval time;
-  gettimeofday(&time, &zone);
-  start_time = (double) time.tv_sec + 1e-6*time.tv_usec;
+  start_time = time_now();
 }
 
 double elapsed_time() {
-  struct timeval time;
-  gettimeofday(&time, &zone);
-  double new_time = (double) time.tv_sec + 1e-6*time.tv_usec;
-  return new_time - start_time;
+  return time_now() - start_time;
 }
@@ -0,0 +1,245 @@
+/* Implementation of parallel samplesort */
+
+#include "csapp.h"
+#include "taskq.h"
+#include "pqsort.h"
+
+/* Maximum number of buckets.  Bucket numbers must fit in a byte */
+#define MAXBUCKET_LOG 8
+/* Samples taken per bucket when choosing splitters */
+#define OVERSAMPLE 16
+/* Smallest block worth handing to a separate task */
+#define MIN_BLOCK (1UL << 14)
+
+/*
+  1. Sort a random sample and take evenly spaced splitters from it.
+  2. Classify each element by descending a perfectly balanced tree of
+     splitters.  The descent is a fixed number of steps with no
+     data-dependent branches.  Bucket numbers are saved in an oracle
+     array, and each block counts its bucket sizes.  If the sample
+     has repeated splitters (heavy duplicate keys), the splitters are
+     deduplicated and every bucket gets a companion equality bucket
+     for keys equal to its upper splitter.  Those need no sorting, so
+     a dominant key does not leave one task sorting most of the data.
+  3. Prefix sums give each block's destination for each bucket.
+     Blocks scatter their elements into scratch.
+  4. Buckets are sorted independently and copied back.
+*/
+
+/* Shared state for one sort */
+typedef struct {
+    data_t *base;
+    data_t *scratch_base;
+    unsigned char *oracle;    /* Bucket number of every element */
+    data_t tree[1 << MAXBUCKET_LOG];  /* Splitters, heap order from 1 */
+    data_t splitter[1 << MAXBUCKET_LOG];  /* Upper splitter of bucket */
+    int log_nbucket;
+    int nbucket;              /* Buckets in the tree */
+    int equal;                /* Use equality buckets */
+    int ntotal;               /* Buckets including equality buckets */
+    size_t *bucket_start;     /* ntotal+1 bucket boundaries in scratch */
+} samplesort_t;
+
+/* One block of classification and scattering */
+typedef struct {
+    samplesort_t *ss;
+    size_t start;
+    size_t nele;
+    size_t count[1 << MAXBUCKET_LOG];  /* Histogram, then positions */
+} sample_block_t;
+
+/* One bucket to sort, or part of an equality bucket to copy back */
+typedef struct {
+    samplesort_t *ss;
+    int bucket;
+    size_t lo, hi;
+} bucket_task_t;
+
+/* Build implicit search tree tree[1..n-1] from sorted splitters s[0..n-2] */
+static void build_tree(data_t *tree, data_t *s, int node, int lo, int hi) {
+    if (lo > hi)
+	return;
+    int mid = (lo + hi) / 2;
+    tree[node] = s[mid];
+    build_tree(tree, s, 2*node, lo, mid-1);
+    build_tree(tree, s, 2*node+1, mid+1, hi);
+}
+
+static void *classify_thread(void *vargp) {
+    sample_block_t *b = (sample_block_t *) vargp;
+    samplesort_t *ss = b->ss;
+    data_t *src = ss->base + b->start;
+    unsigned char *oracle = ss->oracle + b->start;
+    data_t *tree = ss->tree;
+    int log_nbucket = ss->log_nbucket;
+    int nbucket = ss->nbucket;
+    data_t *splitter = ss->splitter;
+    size_t i;
+    int l;
+    memset(b->count, 0, sizeof(b->count));
+    for (i = 0; i < b->nele; i++) {
+	data_t x = src[i];
+	size_t j = 1;
+	for (l = 0; l < log_nbucket; l++)
+	    j = 2*j + (x > tree[j]);
+	j -= nbucket;
+	if (ss->equal)
+	    j = 2*j + ((j < nbucket-1) & (x == splitter[j]));
+	oracle[i] = j;
+	b->count[j]++;
+    }
+    return NULL;
+}
+
+static void *scatter_thread(void *vargp) {
+    sample_block_t *b = (sample_block_t *) vargp;
+    samplesort_t *ss = b->ss;
+    data_t *src = ss->base + b->start;
+    unsigned char *oracle = ss->oracle + b->start;
+    data_t *dest = ss->scratch_base;
+    size_t *pos = b->count;
+    size_t i;
+    for (i = 0; i < b->nele; i++)
+	dest[pos[oracle[i]]++] = src[i];
+    return NULL;
+}
+
+static void *bucket_thread(void *vargp) {
+    bucket_task_t *bt = (bucket_task_t *) vargp;
+    samplesort_t *ss = bt->ss;
+    size_t lo = bt->lo;
+    size_t nele = bt->hi - lo;
+    int is_equal = ss->equal && (bt->bucket & 1);
+    free_task_desc(vargp);
+    if (is_equal)
+	;  /* All keys equal: already in order */
+    else if (use_qsort_lib)
+	qsort_lib(ss->scratch_base + lo, nele, ss->base + lo);
+    else
+	qsort_serial(ss->scratch_base + lo, nele, ss->base + lo);
+    memcpy(ss->base + lo, ss->scratch_base + lo, nele * sizeof(data_t));
+    return NULL;
+}
+
+/* Run routine on every block in parallel */
+static void run_blocks(sample_block_t *blocks, int nblock,
+		       thread_routine_t routine) {
+    task_queue_ptr tq = new_task_queue();
+    int b;
+    for (b = 0; b < nblock; b++)
+	spawn_task(tq, routine, (void *) &blocks[b]);
+    join_tasks(tq);
+    free_task_queue(tq);
+}
+
+/* Parallel samplesort */
+void sample_sort(data_t *base, size_t nele, data_t *scratch_base) {
+    int nworkers = get_task_workers();
+    int log_nbucket = 0;
+    int nblock, b, d;
+    size_t i;
+
+    /* Aim for a few buckets per worker, for load balance.  Leave room
+       to double the count with equality buckets */
+    while (log_nbucket < MAXBUCKET_LOG-1 &&
+	   (1 << log_nbucket) < 4 * nworkers &&
+	   (nele >> log_nbucket) >= 2 * MIN_BLOCK)
+	log_nbucket++;
+    if (log_nbucket == 0) {
+	qsort_serial(base, nele, scratch_base);
+	return;
+    }
+
+    samplesort_t *ss = Malloc(sizeof(samplesort_t));
+    ss->base = base;
+    ss->scratch_base = scratch_base;
+    ss->log_nbucket = log_nbucket;
+    ss->nbucket = 1 << log_nbucket;
+    ss->oracle = Malloc(nele);
+    ss->bucket_start = Malloc((2*ss->nbucket+1) * sizeof(size_t));
+
+    /* Choose splitters from a sorted random sample */
+    size_t nsample = (size_t) OVERSAMPLE * ss->nbucket;
+    data_t *sample = Malloc(nsample * sizeof(data_t));
+    unsigned int seed = 15213;
+    for (i = 0; i < nsample; i++)
+	sample[i] = base[((size_t) rand_r(&seed) * RAND_MAX + rand_r(&seed))
+			 % nele];
+    qsort_serial(sample, nsample, scratch_base);
+    /* Keep distinct splitters only.  Pad by repeating the largest,
+       which leaves the buckets above it empty */
+    int nsplit = 0;
+    for (d = 1; d < ss->nbucket; d++) {
+	data_t s = sample[d * OVERSAMPLE];
+	if (nsplit == 0 || s != ss->splitter[nsplit-1])
+	    ss->splitter[nsplit++] = s;
+    }
+    free(sample);
+    ss->equal = nsplit < ss->nbucket-1;
+    for (d = nsplit; d < ss->nbucket-1; d++)
+	ss->splitter[d] = ss->splitter[nsplit-1];
+    ss->splitter[ss->nbucket-1] = 0;  /* Unused: last bucket has no upper */
+    ss->ntotal = ss->equal ? 2*ss->nbucket : ss->nbucket;
+    build_tree(ss->tree, ss->splitter, 1, 0, ss->nbucket-2);
+
+    /* Classify and count */
+    nblock = nworkers;
+    if (nblock > nele / MIN_BLOCK)
+	nblock = nele / MIN_BLOCK;
+    if (nblock < 1)
+	nblock = 1;
+    size_t npb = nele / nblock;
+    sample_block_t *blocks = Malloc(nblock * sizeof(sample_block_t));
+    for (b = 0; b < nblock; b++) {
+	blocks[b].ss = ss;
+	blocks[b].start = b*npb;
+	blocks[b].nele = (b < nblock-1) ? npb : nele - b*npb;
+    }
+    run_blocks(blocks, nblock, classify_thread);
+
+    /* Prefix sums, bucket-major */
+    size_t sum = 0;
+    for (d = 0; d < ss->ntotal; d++) {
+	ss->bucket_start[d] = sum;
+	for (b = 0; b < nblock; b++) {
+	    size_t c = blocks[b].count[d];
+	    blocks[b].count[d] = sum;
+	    sum += c;
+	}
+    }
+    ss->bucket_start[ss->ntotal] = sum;
+    run_blocks(blocks, nblock, scatter_thread);
+    free(blocks);
+    if (verbose >= 1) {
+	printf("Samplesort: %d buckets%s, %d blocks\n", ss->nbucket,
+	       ss->equal ? " plus equality buckets" : "", nblock);
+	if (verbose >= 2)
+	    for (d = 0; d < ss->ntotal; d++)
+		printf("\tBucket %d%s: %lu elements\n", d,
+		       ss->equal && (d & 1) ? " (equal)" : "",
+		       (printi_t) (ss->bucket_start[d+1] - ss->bucket_start[d]));
+    }
+
+    /* Sort buckets.  Equality buckets only need copying back, which
+       is split into blocks so that a large one is spread over tasks */
+    task_queue_ptr tq = new_task_queue();
+    for (d = 0; d < ss->ntotal; d++) {
+	size_t lo = ss->bucket_start[d], hi = ss->bucket_start[d+1];
+	size_t step = (ss->equal && (d & 1)) ? MIN_BLOCK : hi - lo;
+	do {
+	    bucket_task_t *bt = alloc_task_desc(sizeof(bucket_task_t));
+	    bt->ss = ss;
+	    bt->bucket = d;
+	    bt->lo = lo;
+	    bt->hi = hi - lo > step ? lo + step : hi;
+	    lo = bt->hi;
+	    spawn_task(tq, bucket_thread, (void *) bt);
+	} while (lo < hi);
+    }
+    join_tasks(tq);
+    free_task_queue(tq);
+
+    free(ss->oracle);
+    free(ss->bucket_start);
+    free(ss);
+}
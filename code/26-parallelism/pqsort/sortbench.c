@@ -1,44 +1,365 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <math.h>
 #include "pqsort.h"
+#include "taskq.h"
+#include "gsort.h"
+#include "memplace.h"
 #include "realtimer.h"
+#include "bench.h"
 
 #define MAXCPY 5
 
+/* Inlined-comparison parallel quicksort from gsort.h */
+static void gsort_data(data_t *base, size_t nele, data_t *scratch_base) {
+  gsort_u64_parallel((uint64_t *) base, nele);
+}
+
+/* Sorting algorithms that can be benchmarked */
+typedef struct {
+  char *name;
+  sort_fun_t sfun;
+} sort_alg_t;
+
+static sort_alg_t algs[] = {
+  {"tqsort", tqsort},
+  {"serial", qsort_serial},
+  {"lib", qsort_lib},
+  {"radix", radix_sort},
+  {"sample", sample_sort},
+  {"merge", merge_sort},
+  {"gsort", gsort_data},
+  {NULL, NULL}
+};
+
+static sort_fun_t find_alg(char *name) {
+  int a;
+  for (a = 0; algs[a].name; a++)
+    if (strcmp(algs[a].name, name) == 0)
+      return algs[a].sfun;
+  printf("Unknown algorithm '%s'\n", name);
+  return NULL;
+}
+
+/* Input distributions */
+typedef enum {
+  DIST_RANDOM,   /* Uniform in [0, 2^31) */
+  DIST_SORTED,   /* 0, 1, 2, ... */
+  DIST_REVERSE,  /* n, n-1, ..., 1 */
+  DIST_ORGAN,    /* Ascending, then descending */
+  DIST_FEW,      /* Uniform over FEW_UNIQUE values */
+  DIST_ZIPF,     /* Zipf-like, value k with frequency ~ 1/k */
+  DIST_EQUAL,    /* All elements the same */
+  DIST_KILLER    /* Adversary for qsort_serial's pivot rule (antiqsort) */
+} dist_t;
+
+static char *dist_names[] = {
+  "random", "sorted", "reverse", "organ", "few", "zipf", "equal", "killer", NULL
+};
+
+#define FEW_UNIQUE 16
+
+static dist_t dist = DIST_RANDOM;
+/* DIST_KILLER input, made before generation since it is not per-index */
+static data_t *killer = NULL;
+static unsigned long seed = 1;
+
+/* Pseudo-random 64-bit value for index i (splitmix64).
+   Depends only on seed and i, so blocks can be generated in parallel */
+static unsigned long hash_index(size_t i) {
+  unsigned long z = seed * 0x9e3779b97f4a7c15UL + i + 1;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+/* Value of element i out of nele */
+static data_t gen_value(size_t i, size_t nele) {
+  size_t k = nele / 2;
+  double u;
+  switch (dist) {
+  case DIST_SORTED:
+    return i;
+  case DIST_REVERSE:
+    return nele - i;
+  case DIST_ORGAN:
+    return i < k ? i : nele - i;
+  case DIST_FEW:
+    return hash_index(i) % FEW_UNIQUE;
+  case DIST_ZIPF:
+    /* Continuous approximation: k = nele^u for uniform u */
+    u = (hash_index(i) >> 11) * (1.0 / (1UL << 53));
+    return (data_t) pow((double) nele, u) - 1;
+  case DIST_EQUAL:
+    return 15213;
+  case DIST_KILLER:
+    return killer[i];
+  default:
+    return hash_index(i) & 0x7fffffff;
+  }
+}
+
+/* Distribution number, or -1 if name unknown */
+static int find_dist(char *name) {
+  int d;
+  for (d = 0; dist_names[d]; d++)
+    if (strcmp(dist_names[d], name) == 0)
+      return d;
+  printf("Unknown distribution '%s'\n", name);
+  return -1;
+}
+
 static data_t *data[MAXCPY] = {NULL};
+static size_t data_nele = 0;
+static place_policy_t place_policy = PLACE_DEFAULT;
+static char *place_names[] = {"default", "first", "interleave", NULL};
+/* Report per-node placement and bandwidth of data after generating it? */
+static int report_place = 0;
+
+/* Generating a block of all copies */
+typedef struct {
+  int ncpy;
+  size_t start;
+  size_t nele;      /* Elements in block */
+  size_t total;     /* Elements in whole array */
+} gen_task_t;
+
+#define GEN_BLOCK (1UL << 20)
+
+static void *gen_thread(void *vargp) {
+  gen_task_t *g = (gen_task_t *) vargp;
+  size_t i;
+  int c;
+  for (i = g->start; i < g->start + g->nele; i++) {
+    data_t v = gen_value(i, g->total);
+    for (c = 0; c < g->ncpy; c++)
+      data[c][i] = v;
+  }
+  free_task_desc(vargp);
+  return NULL;
+}
 
 static void gen_data(int ncpy, size_t nele) {
   int c;
   if (ncpy > MAXCPY) {
     printf("Error.  Cannot have more than %d copies of data.  Exiting\n", MAXCPY);
-    exit(0);
+    exit(1);
   }
   for (c = 0; c < ncpy; c++) {
-    data[c] = (data_t *) calloc(nele, sizeof(data_t));
-    if (!data[c]) {
-      printf("Error.  Couldn't generate array of size %lu.  Exiting\n", (printi_t) nele);
-      exit(0);
+    data[c] = (data_t *) alloc_placed(nele * sizeof(data_t), place_policy);
+  }
+  data_nele = nele;
+  if (dist == DIST_KILLER) {
+    free(killer);
+    killer = malloc(nele * sizeof(data_t));
+    if (!killer) {
+      printf("Error.  Cannot allocate killer sequence.  Exiting\n");
+      exit(1);
     }
+    qsort_killer(killer, nele);
   }
-  size_t i;
-  for (i = 0; i < nele; i++) {
-    data_t v = random(); 
-    for (c = 0; c < ncpy; c++)
-      data[c][i] = v; 
+  /* Each block is generated, and first touched, by a pool worker */
+  task_queue_ptr tq = new_task_queue();
+  size_t start;
+  for (start = 0; start < nele; start += GEN_BLOCK) {
+    gen_task_t *g = alloc_task_desc(sizeof(gen_task_t));
+    g->ncpy = ncpy;
+    g->start = start;
+    g->nele = (nele - start < GEN_BLOCK) ? nele - start : GEN_BLOCK;
+    g->total = nele;
+    spawn_task(tq, gen_thread, (void *) g);
   }
+  join_tasks(tq);
+  free_task_queue(tq);
 }
 
 static void free_data() {
   int c;
   for (c = 0; c < MAXCPY; c++) {
     if (data[c]) {
-      free((void *) data[c]);
+      free_placed((void *) data[c], data_nele * sizeof(data_t));
       data[c] = NULL;
     }
   }
 }
 
+/* Compare sorted result against reference.  Exit on mismatch */
+static void check_sorted(data_t *result, data_t *ref, size_t nele) {
+  size_t i;
+  for (i = 0; i < nele; i++) {
+    if (result[i] != ref[i]) {
+      printf("Sort error.  Element %lu/%lu.  Library value = %llu.  Sort value = %llu.\n",
+	     (printi_t) i, (printi_t) nele, (printd_t) ref[i], (printd_t) result[i]);
+      exit(1);
+    }
+    if (i < nele-1 && result[i] > result[i+1]) {
+      printf("Sort error.  Element %lu = %llu.  Element %lu = %llu.\n",
+	     (printi_t) i, (printd_t) result[i], (printi_t) i+1, (printd_t) result[i+1]);
+      exit(1);
+    }
+  }
+}
+
+/*
+  Check of every gsort.h instantiation, serial and parallel, against
+  library qsort.  Values are derived from the current distribution:
+  signed types get negative values, floating types fractions (never
+  NaN), and kv records repeated keys.  gsort_kv is not stable, so its
+  keys must be in order, and each run of equal keys must hold the
+  same values as in the reference.
+*/
+#define GCHECK_CMP(NAME, TYPE)						\
+  static int NAME##_cmp(const void *p, const void *q) {			\
+    TYPE x = *(const TYPE *) p, y = *(const TYPE *) q;			\
+    return (y < x) - (x < y);						\
+  }
+
+#define GCHECK_SCALAR(NAME, TYPE, CONV)					\
+  GCHECK_CMP(NAME, TYPE)						\
+  static void NAME##_check(size_t nele) {				\
+    TYPE *a = malloc(nele * sizeof(TYPE));				\
+    TYPE *ref = malloc(nele * sizeof(TYPE));				\
+    size_t i;								\
+    int par;								\
+    for (par = 0; par < 2; par++) {					\
+      for (i = 0; i < nele; i++)					\
+	a[i] = ref[i] = CONV(gen_value(i, nele), nele);			\
+      qsort(ref, nele, sizeof(TYPE), NAME##_cmp);			\
+      if (par)								\
+	NAME##_parallel(a, nele);					\
+      else								\
+	NAME##_serial(a, nele);						\
+      for (i = 0; i < nele; i++)					\
+	if (a[i] != ref[i]) {						\
+	  printf("Sort error.  %s_%s element %lu/%lu\n", #NAME,		\
+		 par ? "parallel" : "serial", (printi_t) i, (printi_t) nele); \
+	  exit(1);							\
+	}								\
+    }									\
+    free(a);								\
+    free(ref);								\
+  }
+
+#define TO_I32(v, n) ((int32_t) ((v) * 2654435761UL))
+#define TO_U32(v, n) ((uint32_t) (v))
+#define TO_I64(v, n) ((int64_t) (v) - (int64_t) ((n) / 2))
+#define TO_U64(v, n) ((uint64_t) (v))
+#define TO_FLOAT(v, n) ((float) TO_I64(v, n) / 8.0f)
+#define TO_DOUBLE(v, n) ((double) TO_I64(v, n) / 3.0)
+
+GCHECK_SCALAR(gsort_i32, int32_t, TO_I32)
+GCHECK_SCALAR(gsort_u32, uint32_t, TO_U32)
+GCHECK_SCALAR(gsort_i64, int64_t, TO_I64)
+GCHECK_SCALAR(gsort_u64, uint64_t, TO_U64)
+GCHECK_SCALAR(gsort_float, float, TO_FLOAT)
+GCHECK_SCALAR(gsort_double, double, TO_DOUBLE)
+
+/* Order by key, then value */
+static int kv_cmp(const void *p, const void *q) {
+  const kv_t *x = p, *y = q;
+  if (x->key != y->key)
+    return (y->key < x->key) - (x->key < y->key);
+  return (y->val < x->val) - (x->val < y->val);
+}
+
+static void gsort_kv_check(size_t nele) {
+  kv_t *a = malloc(nele * sizeof(kv_t));
+  kv_t *ref = malloc(nele * sizeof(kv_t));
+  size_t i, j;
+  int par;
+  for (par = 0; par < 2; par++) {
+    for (i = 0; i < nele; i++) {
+      a[i].key = gen_value(i, nele) % (nele / 16 + 1);
+      a[i].val = i;
+      ref[i] = a[i];
+    }
+    qsort(ref, nele, sizeof(kv_t), kv_cmp);
+    if (par)
+      gsort_kv_parallel(a, nele);
+    else
+      gsort_kv_serial(a, nele);
+    for (i = 0; i < nele; i = j) {
+      for (j = i+1; j < nele && a[j].key == a[i].key; j++)
+	;
+      qsort(a + i, j - i, sizeof(kv_t), kv_cmp);
+    }
+    for (i = 0; i < nele; i++)
+      if (a[i].key != ref[i].key || a[i].val != ref[i].val) {
+	printf("Sort error.  gsort_kv_%s element %lu/%lu\n",
+	       par ? "parallel" : "serial", (printi_t) i, (printi_t) nele);
+	exit(1);
+      }
+  }
+  free(a);
+  free(ref);
+}
+
+static void check_gsort_types(size_t nele) {
+  gsort_i32_check(nele);
+  gsort_u32_check(nele);
+  gsort_i64_check(nele);
+  gsort_u64_check(nele);
+  gsort_float_check(nele);
+  gsort_double_check(nele);
+  gsort_kv_check(nele);
+  if (verbose >= 1)
+    printf("All gsort instantiations match qsort\n");
+}
+
+/* Run tqsort and qsort_serial with every partition kernel the CPU
+   has, on inputs full of duplicates, and compare with the library
+   sort.  Kernels that put all keys equal to the pivot on one side go
+   quadratic on these */
+static void check_partition_kernels(size_t nele) {
+  static char *knames[] = {"sweep", "block", "avx2", "avx512", NULL};
+  static dist_t dists[] = {DIST_FEW, DIST_EQUAL};
+  part_kernel_t save_kernel = partition_kernel;
+  dist_t save_dist = dist;
+  data_t *a, *ref, *scratch;
+  size_t i;
+  int k, d, par;
+  if (nele > (1 << 20))
+    nele = 1 << 20;
+  a = malloc(nele * sizeof(data_t));
+  ref = malloc(nele * sizeof(data_t));
+  scratch = malloc(nele * sizeof(data_t));
+  if (!a || !ref || !scratch) {
+    printf("Error.  Out of memory for kernel check\n");
+    exit(1);
+  }
+  for (k = 0; knames[k]; k++) {
+    if (!select_partition_kernel(knames[k]))
+      continue;
+    for (d = 0; d < 2; d++) {
+      dist = dists[d];
+      for (i = 0; i < nele; i++)
+	ref[i] = gen_value(i, nele);
+      qsort_lib(ref, nele, scratch);
+      for (par = 0; par < 2; par++) {
+	for (i = 0; i < nele; i++)
+	  a[i] = gen_value(i, nele);
+	if (par)
+	  tqsort(a, nele, scratch);
+	else
+	  qsort_serial(a, nele, scratch);
+	if (verbose >= 1)
+	  printf("Kernel %s, %s sort, %s data: ", knames[k],
+		 par ? "parallel" : "serial", dist_names[dist]);
+	check_sorted(a, ref, nele);
+	if (verbose >= 1)
+	  printf("OK\n");
+      }
+    }
+  }
+  partition_kernel = save_kernel;
+  dist = save_dist;
+  free(a);
+  free(ref);
+  free(scratch);
+}
+
 /* Test sort function.  Optionally compare results to library version.
    If comp_ptr non-NULL, set it to the number of comparisons
    Return number of seconds */
@@ -48,6 +369,10 @@ static double run_test(sort_fun_t sfun, size_t nele, int check,
   double t;
   int ncpy = check ? 3 : 2;
   gen_data(ncpy, nele);
+  if (report_place) {
+    printf("Placement of %s data:\n", place_names[place_policy]);
+    report_placement(data[0], nele * sizeof(data_t));
+  }
   if (verbose >= 2) {
     printf("Initial data:");
     show_data(data[0], nele);
@@ -63,35 +388,186 @@ static double run_test(sort_fun_t sfun, size_t nele, int check,
   if (comp_ptr)
     *comp_ptr = comp_cnt;
   if (check) {
-    size_t i;
     qsort_lib(data[2], nele, data[1]);
-    for (i = 0; i < nele; i++) {
-      if (data[0][i] != data[2][i]) {
-	printf("Sort error.  Element %lu/%lu.  Library value = %llu.  Sort value = %llu.\n",
-	       (printi_t) i, (printi_t) nele, (printd_t) data[2][i], (printd_t) data[0][i]);
-	exit(0);
-      }
-      if (i < nele-1 && data[0][i] > data[0][i+1]) {
-	printf("Sort error.  Element %lu = %llu.  Element %lu = %llu.\n",
-	       (printi_t) i, (printd_t) data[0][i], (printi_t) i+1, (printd_t) data[0][i+1]);
-	exit(0);
-      }
-    }
+    check_sorted(data[0], data[2], nele);
+    if (sfun == gsort_data)
+      check_gsort_types(nele);
+    check_partition_kernels(nele);
   }
   free_data();
   return t;
 }
 
+/* Parameter sweep.
+   Input is generated once.  Every trial sorts a fresh copy of it */
+typedef enum { OUT_TEXT, OUT_CSV, OUT_JSON } out_fmt_t;
+static char *fmt_names[] = {"text", "csv", "json", NULL};
+
+static int ntrials = 5;          /* Timed runs per cell */
+static int nwarmup = 1;          /* Untimed runs per cell */
+static int max_threads = 0;      /* Top of worker sweep.  0: current workers */
+static int log_max_sfrac = 14;   /* Sweep serial_sort_fraction to 2^this */
+static int log_max_pfrac = 4;    /* Sweep serial_partition_fraction to 2^this */
+static out_fmt_t out_fmt = OUT_TEXT;
+
+typedef struct {
+  data_t *src;
+  data_t *dest;
+  size_t nele;
+} copy_data_task_t;
+
+static void *copy_data_thread(void *vargp) {
+  copy_data_task_t *ct = (copy_data_task_t *) vargp;
+  memcpy(ct->dest, ct->src, ct->nele * sizeof(data_t));
+  free_task_desc(vargp);
+  return NULL;
+}
+
+static void copy_data(data_t *dest, data_t *src, size_t nele) {
+  task_queue_ptr tq = new_task_queue();
+  size_t start;
+  for (start = 0; start < nele; start += GEN_BLOCK) {
+    copy_data_task_t *ct = alloc_task_desc(sizeof(copy_data_task_t));
+    ct->src = src + start;
+    ct->dest = dest + start;
+    ct->nele = (nele - start < GEN_BLOCK) ? nele - start : GEN_BLOCK;
+    spawn_task(tq, copy_data_thread, (void *) ct);
+  }
+  join_tasks(tq);
+  free_task_queue(tq);
+}
+
+/* One cell of the grid, as a benchmark closure.  Every sample sorts a
+   fresh copy of the input, made outside the timed region */
+typedef struct {
+  sort_fun_t sfun;
+  size_t nele;
+  int check;                     /* Check the next sorted result */
+} cell_t;
+
+static void cell_setup(void *arg) {
+  cell_t *c = (cell_t *) arg;
+  copy_data(data[2], data[0], c->nele);
+}
+
+static void cell_run(void *arg) {
+  cell_t *c = (cell_t *) arg;
+  c->sfun(data[2], c->nele, data[1]);
+}
+
+static void cell_teardown(void *arg) {
+  cell_t *c = (cell_t *) arg;
+  if (c->check) {
+    check_sorted(data[2], data[3], c->nele);
+    c->check = 0;
+  }
+}
+
+/* Time one cell of the grid and print its statistics.  Takes exactly
+   ntrials samples, on the wall clock since the sort uses every CPU;
+   they count as converged if all are within 1% */
+static void run_cell(sort_fun_t sfun, char *alg_name, size_t nele,
+		     int check, int nthreads, int *first) {
+  cell_t c = {sfun, nele, check};
+  bench_closure_t b = {cell_run, cell_setup, cell_teardown, &c};
+  bench_params_t p = {ntrials, 0.01, ntrials, nwarmup,
+		      BENCH_FLUSH_NONE, BENCH_CLOCK_WALL};
+  bench_result_t r;
+  bench_run(&b, &p, &r);
+  switch (out_fmt) {
+  case OUT_JSON:
+    printf("%s\n  {\"alg\": \"%s\", \"dist\": \"%s\", \"nele\": %lu, "
+	   "\"workers\": %d, \"sfrac\": %lu, \"pfrac\": %lu, \"seconds\": ",
+	   *first ? "" : ",", alg_name, dist_names[dist], (printi_t) nele,
+	   nthreads, (printi_t) serial_sort_fraction,
+	   (printi_t) serial_partition_fraction);
+    bench_print_json(stdout, alg_name, &r);
+    printf("  }");
+    break;
+  default:
+    printf(out_fmt == OUT_CSV ?
+	   "%s,%s,%lu,%d,%lu,%lu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n" :
+	   "%s\t%s\t%lu\t%d\t%lu\t%lu\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+	   alg_name, dist_names[dist], (printi_t) nele, nthreads,
+	   (printi_t) serial_sort_fraction, (printi_t) serial_partition_fraction,
+	   r.min, r.median, r.mean, r.stddev, r.ci_lo, r.ci_hi);
+  }
+  bench_free(&r);
+  *first = 0;
+  fflush(stdout);
+}
+
+/* Sweep worker counts 1, 2, 4, ..., max_threads and, for tqsort, the
+   grid of serial sort and partition fractions.  The workers column
+   counts pool threads only: the calling thread also runs tasks while
+   it waits in join_tasks, so up to workers+1 threads sort at once */
+static void run_sweep(sort_fun_t sfun, char *alg_name, size_t nele, int check) {
+  int first = 1;
+  int nthreads, f, pf;
+  if (max_threads <= 0)
+    max_threads = get_task_workers();
+  gen_data(check ? 4 : 3, nele);
+  if (check)
+    qsort_lib(data[3], nele, data[1]);
+  if (out_fmt == OUT_JSON)
+    printf("[");
+  else
+    printf(out_fmt == OUT_CSV ?
+	   "alg,dist,nele,workers,sfrac,pfrac,min,median,mean,stddev,ci_lo,ci_hi\n" :
+	   "alg\tdist\tnele\tworkers\tsfrac\tpfrac\tmin\tmedian\tmean\tstddev\tci_lo\tci_hi\n");
+  for (nthreads = 1; ; nthreads *= 2) {
+    if (nthreads > max_threads)
+      nthreads = max_threads;
+    set_task_workers(nthreads);
+    if (sfun == tqsort) {
+      for (f = 0; f <= log_max_sfrac; f++)
+	for (pf = 0; pf <= f && pf <= log_max_pfrac; pf++) {
+	  serial_sort_fraction = 1UL << f;
+	  serial_partition_fraction = 1UL << pf;
+	  run_cell(sfun, alg_name, nele, check, nthreads, &first);
+	}
+    } else
+      run_cell(sfun, alg_name, nele, check, nthreads, &first);
+    if (nthreads == max_threads)
+      break;
+  }
+  if (out_fmt == OUT_JSON)
+    printf("\n]\n");
+  free_data();
+}
+
 static void usage(char *cmdname) {
-  printf("Usage: %s [-hlc] [-n nele] [-v verb] [-t tlim] [-f sfrac] [-f pfrac]\n", cmdname);
+  printf("Usage: %s [-hlcCAPS] [-a alg] [-k kern] [-d dist] [-s seed] [-n nele] [-v verb] [-t tlim] [-f sfrac] [-f pfrac]\n", cmdname);
+  int a;
   printf("\t-h\tPrint this message\n");
+  printf("\t-a alg\tSorting algorithm:");
+  for (a = 0; algs[a].name; a++)
+    printf(" %s", algs[a].name);
+  printf(" (default tqsort)\n");
+  printf("\t-k kern\tPartition kernel: sweep block avx2 avx512 simd (default sweep)\n");
+  printf("\t-d dist\tInput distribution:");
+  for (a = 0; dist_names[a]; a++)
+    printf(" %s", dist_names[a]);
+  printf(" (default random)\n");
+  printf("\t-s seed\tSeed for random distributions\n");
   printf("\t-n nele\tSet number of elements\n");
   printf("\t-v verb\tSet verbosity level\n");
-  printf("\t-t tlim\tSet limit on number of concurrent threads\n");
+  printf("\t-t tlim\tSet number of worker threads (default: one per core)\n");
   printf("\t-f frac\tFraction of total when start doing sequential sort\n");
   printf("\t-F frac\tFraction of total when start doing sequential partition\n");
+  printf("\t-m place\tMemory placement: default first interleave\n");
+  printf("\t-A\tPin worker threads to CPUs\n");
+  printf("\t-P\tReport per-node placement and read bandwidth of data\n");
   printf("\t-l\tUse library qsort for serial sort\n");
-  printf("\t-c\tCheck result against library qsort\n");
+  printf("\t-C\tPartition in parallel by copying through scratch (tqsort)\n");
+  printf("\t-c\tCheck result against library qsort (gsort: every element type),\n\t\tand every partition kernel on few and equal data\n");
+  printf("\t-S\tSweep threads (and for tqsort, -f and -F) over a grid\n");
+  printf("\t-r trials\tTimed trials per grid cell (default 5)\n");
+  printf("\t-w warm\tUntimed warmup runs per grid cell (default 1)\n");
+  printf("\t-T tmax\tSweep workers 1, 2, 4, ... up to tmax (default: -t).\n\t\tThe calling thread runs tasks too\n");
+  printf("\t-x lgf\tSweep -f from 1 to 2^lgf (default 14)\n");
+  printf("\t-X lgF\tSweep -F from 1 to 2^lgF (default 4)\n");
+  printf("\t-o fmt\tSweep output format: text csv json\n");
   exit(0);
 }
 
@@ -100,25 +576,99 @@ int main(int argc, char *argv[]) {
   size_t comps = 0;
   int c;
   int check = 0;
-  while ((c = getopt(argc, argv, "hn:v:f:F:lc")) != -1) {
+  sort_fun_t sfun = tqsort;
+  char *alg_name = "tqsort";
+  int sweep = 0;
+  while ((c = getopt(argc, argv, "ha:k:d:s:m:n:v:t:f:F:lcCAPSr:w:T:x:X:o:")) != -1) {
     switch(c) {
     case 'h': usage(argv[0]);
       break;
+    case 'a':
+      if (!(sfun = find_alg(optarg)))
+	usage(argv[0]);
+      alg_name = optarg;
+      break;
+    case 'S':
+      sweep = 1;
+      break;
+    case 'r':
+      ntrials = atoi(optarg);
+      if (ntrials < 1)
+	usage(argv[0]);
+      break;
+    case 'w':
+      nwarmup = atoi(optarg);
+      break;
+    case 'T':
+      max_threads = atoi(optarg);
+      break;
+    case 'x':
+      log_max_sfrac = atoi(optarg);
+      break;
+    case 'X':
+      log_max_pfrac = atoi(optarg);
+      break;
+    case 'o':
+      for (out_fmt = 0; fmt_names[out_fmt]; out_fmt++)
+	if (strcmp(fmt_names[out_fmt], optarg) == 0)
+	  break;
+      if (!fmt_names[out_fmt]) {
+	printf("Unknown output format '%s'\n", optarg);
+	usage(argv[0]);
+      }
+      break;
+    case 'k':
+      if (!select_partition_kernel(optarg)) {
+	printf("Partition kernel '%s' unknown or unsupported\n", optarg);
+	usage(argv[0]);
+      }
+      break;
+    case 'd': {
+      int d = find_dist(optarg);
+      if (d < 0)
+	usage(argv[0]);
+      dist = d;
+      break;
+    }
+    case 's':
+      seed = strtoul(optarg, NULL, 0);
+      break;
     case 'n':
       nele = strtoul(optarg, NULL, 0);
       break;
     case 'v':
       verbose = atoi(optarg);
       break;
+    case 't':
+      set_task_workers(atoi(optarg));
+      break;
     case 'f':
       serial_sort_fraction = strtoul(optarg, NULL, 0);
       break;
     case 'F':
       serial_partition_fraction = strtoul(optarg, NULL, 0);
       break;
+    case 'm':
+      for (place_policy = 0; place_names[place_policy]; place_policy++)
+	if (strcmp(place_names[place_policy], optarg) == 0)
+	  break;
+      if (!place_names[place_policy]) {
+	printf("Unknown placement '%s'\n", optarg);
+	usage(argv[0]);
+      }
+      break;
+    case 'A':
+      set_task_affinity(1);
+      break;
+    case 'P':
+      report_place = 1;
+      break;
     case 'l':
       use_qsort_lib = 1;
       break;
+    case 'C':
+      use_partition_copy = 1;
+      break;
     case 'c':
       check = 1;
       break;
@@ -127,10 +677,18 @@ int main(int argc, char *argv[]) {
       usage(argv[0]);
     }
   }
-  double t = run_test(tqsort, nele, check, &comps);
+  if (sweep) {
+    run_sweep(sfun, alg_name, nele, check);
+    return 0;
+  }
+  double t = run_test(sfun, nele, check, &comps);
   printf("%.2f seconds\n", t);
 #ifdef LOGCOMPS
   printf("%lu comparisons\n", comps);
+  size_t ndesc, nmalloc;
+  task_desc_stats(&ndesc, &nmalloc);
+  printf("%lu task descriptors from %lu mallocs\n",
+	 (printi_t) ndesc, (printi_t) nmalloc);
 #endif
   return 0;
 }
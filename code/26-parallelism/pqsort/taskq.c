@@ -1,92 +1,483 @@
+#define _GNU_SOURCE
+#include <sched.h>
 #include "csapp.h"
 #include "taskq.h"
 
-/* Create and reap queue of tasks */
-task_queue_ptr new_task_queue() {
-    task_queue_ptr tq = Malloc(sizeof(task_queue_t));
-    tq->active_count = tq->max_active_count = 0;
-    tq->head = tq->tail = NULL;
-    pthread_mutex_init(&tq->mutex, NULL);
-#ifdef SEM
-    sem_init(&tq->reap_ok, 0, 0);
-#endif
-    return tq;
+/* Work-stealing pool of worker threads */
+
+#define MAXWORKERS 256
+/* Initial number of slots in each deque (power of 2) */
+#define DEQUE_INIT_SIZE 1024
+/* Failed searches for work before an idle worker goes to sleep */
+#define IDLE_TRIES 64
+/* Descriptors obtained per malloc when a free list runs dry */
+#define DESC_CHUNK 256
+
+/* Circular array backing a deque.  Replaced by one twice as large
+   when full; old arrays stay around since thieves may still read them */
+typedef struct DARRAY {
+    long size;
+    struct DARRAY *prev;
+    task_ptr buf[];
+} deque_array_t;
+
+/* Chase-Lev deque.  Owner works at bottom, thieves take from top */
+typedef struct {
+    volatile long top;
+    volatile long bottom;
+    deque_array_t *array;
+} __attribute__((aligned(64))) deque_t;
+
+/* Workers allowed to run tasks.  Those numbered nworkers and up sleep */
+static volatile int nworkers = 0;
+/* Worker threads created so far */
+static volatile int nstarted = 0;
+static int pin_workers = 0;
+/* CPUs in the process's affinity mask, in order.  Worker i runs on
+   allowed_cpu[i % nallowed] when pinned */
+static int allowed_cpu[CPU_SETSIZE];
+static int nallowed = 0;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static deque_t deques[MAXWORKERS];
+/* Index of the calling thread's deque, or -1 outside the pool */
+static __thread int my_worker = -1;
+static __thread unsigned int my_seed = 0;
+
+/* Tasks spawned from outside the pool */
+static pthread_mutex_t inject_mutex = PTHREAD_MUTEX_INITIALIZER;
+static task_ptr inject_head = NULL;
+static task_ptr inject_tail = NULL;
+
+/* Idle workers sleep here until a task is spawned */
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static volatile int nsleeping = 0;
+/* Workers beyond nworkers wait here until the pool grows */
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+
+/* Free descriptors are linked through their first word.  Each fills
+   its own cache line, so neighbors freed by different threads never
+   share one */
+typedef union DESC {
+    struct {
+	union DESC *next;
+	union DESC *batch;  /* Next batch in the global pool */
+    } link;
+    char data[TASK_DESC_SIZE];
+} __attribute__((aligned(64))) desc_t;
+
+/* A thread holding more than DESC_FREE_MAX free descriptors (as
+   thieves do, since they free what others allocated) hands
+   DESC_CHUNK of them to a global pool, where allocating threads
+   look before calling malloc */
+#define DESC_FREE_MAX (2 * DESC_CHUNK)
+static pthread_mutex_t desc_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static desc_t *desc_pool = NULL;
+
+/* Per-thread counts, summed by task_desc_stats.  Kept on the heap
+   and linked together so they outlive their threads */
+typedef struct DSTATS {
+    size_t nalloc;
+    size_t nmalloc;
+    struct DSTATS *next;
+} desc_stats_t;
+static desc_stats_t *desc_stats_list = NULL;
+
+static __thread desc_t *desc_free_list = NULL;
+static __thread long desc_free_cnt = 0;
+static __thread desc_stats_t *my_desc_stats = NULL;
+
+static desc_stats_t *get_desc_stats() {
+    if (!my_desc_stats) {
+	my_desc_stats = Calloc(1, sizeof(desc_stats_t));
+	pthread_mutex_lock(&desc_pool_mutex);
+	my_desc_stats->next = desc_stats_list;
+	desc_stats_list = my_desc_stats;
+	pthread_mutex_unlock(&desc_pool_mutex);
+    }
+    return my_desc_stats;
 }
 
+/* Refill empty free list from the pool, else from a fresh chunk */
+static void refill_desc() {
+    desc_stats_t *st = get_desc_stats();
+    desc_t *d;
+    int i;
+    pthread_mutex_lock(&desc_pool_mutex);
+    d = desc_pool;
+    if (d)
+	desc_pool = d->link.batch;
+    pthread_mutex_unlock(&desc_pool_mutex);
+    if (!d) {
+	int rc = posix_memalign((void **) &d, 64, DESC_CHUNK * sizeof(desc_t));
+	if (rc != 0)
+	    posix_error(rc, "refill_desc: posix_memalign");
+	for (i = 0; i < DESC_CHUNK-1; i++)
+	    d[i].link.next = &d[i+1];
+	d[DESC_CHUNK-1].link.next = NULL;
+	__atomic_store_n(&st->nmalloc, st->nmalloc + 1, __ATOMIC_RELAXED);
+    }
+    desc_free_list = d;
+    desc_free_cnt = DESC_CHUNK;
+}
 
-void free_task_queue(task_queue_ptr tq) {
-    /* Assumes that queue is already empty */
-    free((void *) tq);
+void *alloc_task_desc(size_t size) {
+    desc_t *d;
+    if (size > TASK_DESC_SIZE)
+	app_error("alloc_task_desc: descriptor too large");
+    if (!desc_free_list)
+	refill_desc();
+    d = desc_free_list;
+    desc_free_list = d->link.next;
+    desc_free_cnt--;
+    /* Only this thread writes its counter */
+    desc_stats_t *st = get_desc_stats();
+    __atomic_store_n(&st->nalloc, st->nalloc + 1, __ATOMIC_RELAXED);
+    return (void *) d;
 }
 
-/* Create a new task, spawning thread.  Return nonzero if successful */
-void spawn_task(task_queue_ptr tq, thread_routine_t routine, void *tdata) {
-    int first_task = 0;
-    /* Create new task element */
-    task_list_ptr ele = Malloc(sizeof(task_list_t));
-    ele->next = NULL;
-    /* Acquire lock to queue state */
-    pthread_mutex_lock(&tq->mutex);
-    first_task = tq->max_active_count == 0;
-    if (tq->tail)
-	tq->tail->next = ele;
+/* Descriptor goes onto the free list of the thread releasing it */
+void free_task_desc(void *p) {
+    desc_t *d = (desc_t *) p;
+    d->link.next = desc_free_list;
+    desc_free_list = d;
+    if (++desc_free_cnt > DESC_FREE_MAX) {
+	/* Split off the most recently freed DESC_CHUNK as a batch */
+	desc_t *batch = desc_free_list, *last = batch;
+	int i;
+	for (i = 1; i < DESC_CHUNK; i++)
+	    last = last->link.next;
+	desc_free_list = last->link.next;
+	last->link.next = NULL;
+	desc_free_cnt -= DESC_CHUNK;
+	pthread_mutex_lock(&desc_pool_mutex);
+	batch->link.batch = desc_pool;
+	desc_pool = batch;
+	pthread_mutex_unlock(&desc_pool_mutex);
+    }
+}
+
+void task_desc_stats(size_t *nalloc, size_t *nmalloc) {
+    desc_stats_t *st;
+    *nalloc = *nmalloc = 0;
+    pthread_mutex_lock(&desc_pool_mutex);
+    for (st = desc_stats_list; st; st = st->next) {
+	*nalloc += __atomic_load_n(&st->nalloc, __ATOMIC_RELAXED);
+	*nmalloc += __atomic_load_n(&st->nmalloc, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&desc_pool_mutex);
+}
+
+static deque_array_t *new_deque_array(long size, deque_array_t *prev) {
+    deque_array_t *a = Malloc(sizeof(deque_array_t) + size * sizeof(task_ptr));
+    a->size = size;
+    a->prev = prev;
+    return a;
+}
+
+static void deque_init(deque_t *d) {
+    d->top = d->bottom = 0;
+    d->array = new_deque_array(DEQUE_INIT_SIZE, NULL);
+}
+
+/* Owner only: add task at bottom */
+static void deque_push(deque_t *d, task_ptr t) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    deque_array_t *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    if (b - top > a->size - 1) {
+	/* Full.  Copy live entries into larger array */
+	deque_array_t *na = new_deque_array(2 * a->size, a);
+	long i;
+	for (i = top; i < b; i++)
+	    na->buf[i & (na->size-1)] = a->buf[i & (a->size-1)];
+	__atomic_store_n(&d->array, na, __ATOMIC_RELEASE);
+	a = na;
+    }
+    __atomic_store_n(&a->buf[b & (a->size-1)], t, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b+1, __ATOMIC_RELAXED);
+}
+
+/* Owner only: remove most recently pushed task.  NULL if empty */
+static task_ptr deque_take(deque_t *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    deque_array_t *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    task_ptr t = NULL;
+    if (top <= b) {
+	t = __atomic_load_n(&a->buf[b & (a->size-1)], __ATOMIC_RELAXED);
+	if (top == b) {
+	    /* Last element.  Race against thieves for it */
+	    if (!__atomic_compare_exchange_n(&d->top, &top, top+1, 0,
+					     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		t = NULL;
+	    __atomic_store_n(&d->bottom, b+1, __ATOMIC_RELAXED);
+	}
+    } else
+	__atomic_store_n(&d->bottom, b+1, __ATOMIC_RELAXED);
+    return t;
+}
+
+/* Any thread: remove oldest task.  NULL if empty or lost race */
+static task_ptr deque_steal(deque_t *d) {
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b)
+	return NULL;
+    deque_array_t *a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+    task_ptr t = __atomic_load_n(&a->buf[top & (a->size-1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top+1, 0,
+				     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	return NULL;
+    return t;
+}
+
+static void inject_push(task_ptr t) {
+    t->next = NULL;
+    pthread_mutex_lock(&inject_mutex);
+    if (inject_tail)
+	inject_tail->next = t;
     else
-	tq->head = ele;
-    tq->tail = ele;
-    tq->active_count++;
-    if (tq->active_count > tq->max_active_count)
-	tq->max_active_count = tq->active_count;
-    Pthread_create(&ele->tid, NULL, routine, tdata);
-#ifdef SEM
-    if (first_task)
-	sem_post(&tq->reap_ok);
-#endif
-    pthread_mutex_unlock(&tq->mutex);
+	__atomic_store_n(&inject_head, t, __ATOMIC_RELAXED);
+    inject_tail = t;
+    pthread_mutex_unlock(&inject_mutex);
+}
+
+static task_ptr inject_take() {
+    task_ptr t;
+    if (!__atomic_load_n(&inject_head, __ATOMIC_RELAXED))
+	return NULL;
+    pthread_mutex_lock(&inject_mutex);
+    t = inject_head;
+    if (t) {
+	__atomic_store_n(&inject_head, t->next, __ATOMIC_RELAXED);
+	if (!t->next)
+	    inject_tail = NULL;
+    }
+    pthread_mutex_unlock(&inject_mutex);
+    return t;
 }
 
+/* Look for a task: own deque first, then injection list, then steal */
+static task_ptr find_task() {
+    task_ptr t;
+    int i, start;
+    int n = __atomic_load_n(&nstarted, __ATOMIC_ACQUIRE);
+    if (my_worker >= 0 && (t = deque_take(&deques[my_worker])) != NULL)
+	return t;
+    if ((t = inject_take()) != NULL)
+	return t;
+    if (n == 0)
+	return NULL;
+    start = rand_r(&my_seed) % n;
+    for (i = 0; i < n; i++) {
+	int v = (start + i) % n;
+	if (v != my_worker && (t = deque_steal(&deques[v])) != NULL)
+	    return t;
+    }
+    return NULL;
+}
 
+/* Is there anything to steal? */
+static int work_available() {
+    int i;
+    int n = __atomic_load_n(&nstarted, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&inject_head, __ATOMIC_SEQ_CST))
+	return 1;
+    for (i = 0; i < n; i++)
+	if (__atomic_load_n(&deques[i].bottom, __ATOMIC_SEQ_CST) >
+	    __atomic_load_n(&deques[i].top, __ATOMIC_SEQ_CST))
+	    return 1;
+    return 0;
+}
 
-/* Join all tasks in queue.  Won't return until queue becomes empty.
-   Returns maximum number of concurrrent tasks
-*/
-int join_tasks(task_queue_ptr tq) {
-#ifdef SEM
-    /*
-      This may be needed at the very beginning
-      in case no tasks have been queued yet
-    */
-    P(&tq->reap_ok);
-#endif
-    /* Basic loop:
-       Assumes that queue won't become empty until all tasks completed. */
+static void run_task(task_ptr t) {
+    task_queue_ptr tq = t->tq;
+    t->routine(t->tdata);
+    free_task_desc(t);
+    /* Last access to tq.  Joiner may free it as soon as count hits 0 */
+    __atomic_fetch_sub(&tq->active_count, 1, __ATOMIC_RELEASE);
+}
+
+static void *worker_thread(void *vargp) {
+    int tries = 0;
+    my_worker = (int) (long) vargp;
+    my_seed = my_worker + 1;
+    if (pin_workers)
+	pin_to_worker_cpu(my_worker);
     while (1) {
-	pthread_mutex_lock(&tq->mutex);
-	task_list_ptr old_head = tq->head;
-	if (old_head == NULL) {
-	    pthread_mutex_unlock(&tq->mutex);
-	    return tq->max_active_count;
+	task_ptr t = (my_worker < nworkers) ? find_task() : NULL;
+	if (t) {
+	    run_task(t);
+	    tries = 0;
+	} else if (my_worker >= nworkers) {
+	    pthread_mutex_lock(&idle_mutex);
+	    while (my_worker >= nworkers)
+		pthread_cond_wait(&park_cond, &idle_mutex);
+	    pthread_mutex_unlock(&idle_mutex);
+	    tries = 0;
+	} else if (++tries < IDLE_TRIES) {
+	    sched_yield();
 	} else {
-	    pthread_t tid = old_head->tid;
-	    tq->head = old_head->next;
-	    if (old_head == tq->tail)
-		tq->tail = NULL;
-	    tq->active_count--;
-	    pthread_mutex_unlock(&tq->mutex);
-	    free((void *) old_head);
-	    Pthread_join(tid, NULL);
+	    pthread_mutex_lock(&idle_mutex);
+	    __atomic_fetch_add(&nsleeping, 1, __ATOMIC_SEQ_CST);
+	    if (!work_available())
+		pthread_cond_wait(&idle_cond, &idle_mutex);
+	    __atomic_fetch_sub(&nsleeping, 1, __ATOMIC_SEQ_CST);
+	    pthread_mutex_unlock(&idle_mutex);
+	    tries = 0;
 	}
     }
+    return NULL;
+}
+
+/* Make n workers active, creating threads as needed.
+   Caller holds pool_mutex or is init_pool */
+static void resize_pool(int n) {
+    long i;
+    pthread_t tid;
+    if (n <= 0)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > MAXWORKERS)
+	n = MAXWORKERS;
+    for (i = nstarted; i < n; i++) {
+	deque_init(&deques[i]);
+	__atomic_store_n(&nstarted, i+1, __ATOMIC_RELEASE);
+	Pthread_create(&tid, NULL, worker_thread, (void *) i);
+	Pthread_detach(tid);
+    }
+    __atomic_store_n(&nworkers, n, __ATOMIC_SEQ_CST);
 }
 
+/* Record the CPUs we may run on before any worker is pinned */
+static void init_allowed_cpus() {
+    cpu_set_t set;
+    int c;
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+	fprintf(stderr, "sched_getaffinity: %s\n", strerror(errno));
+	CPU_ZERO(&set);
+	for (c = 0; c < sysconf(_SC_NPROCESSORS_ONLN) && c < CPU_SETSIZE; c++)
+	    CPU_SET(c, &set);
+    }
+    for (c = 0; c < CPU_SETSIZE; c++)
+	if (CPU_ISSET(c, &set))
+	    allowed_cpu[nallowed++] = c;
+}
 
+static void init_pool() {
+    init_allowed_cpus();
+    resize_pool(nworkers);
+}
 
+/* Before the pool starts, sets its initial size.  Afterwards, changes
+   the number of active workers; only call when no tasks are queued */
+void set_task_workers(int n) {
+    if (__atomic_load_n(&nstarted, __ATOMIC_ACQUIRE) == 0) {
+	nworkers = n;
+	return;
+    }
+    pthread_mutex_lock(&pool_mutex);
+    pthread_mutex_lock(&idle_mutex);
+    resize_pool(n);
+    /* Unpark workers that are active again, and wake sleepers so
+       that any no longer active move over to park_cond */
+    pthread_cond_broadcast(&park_cond);
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&idle_mutex);
+    pthread_mutex_unlock(&pool_mutex);
+}
 
+void set_task_affinity(int on) {
+    pin_workers = on;
+}
+
+int task_worker_cpu(int i) {
+    Pthread_once(&pool_once, init_pool);
+    if (!pin_workers || nallowed == 0)
+	return -1;
+    return allowed_cpu[i % nallowed];
+}
+
+int pin_to_worker_cpu(int i) {
+    int cpu = task_worker_cpu(i);
+    cpu_set_t set;
+    int rc;
+    if (cpu < 0)
+	return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if ((rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+	fprintf(stderr, "Warning: can't pin worker %d to CPU %d: %s\n",
+		i, cpu, strerror(rc));
+	return -1;
+    }
+    return cpu;
+}
 
+int get_task_workers() {
+    Pthread_once(&pool_once, init_pool);
+    return nworkers;
+}
 
+/* Create and reap queue of tasks */
+task_queue_ptr new_task_queue() {
+    task_queue_ptr tq = Malloc(sizeof(task_queue_t));
+    tq->active_count = tq->max_active_count = 0;
+    return tq;
+}
 
 
+void free_task_queue(task_queue_ptr tq) {
+    /* Assumes that queue is already empty */
+    free((void *) tq);
+}
 
+/* Create a new task and make it available to the worker pool */
+void spawn_task(task_queue_ptr tq, thread_routine_t routine, void *tdata) {
+    Pthread_once(&pool_once, init_pool);
+    task_ptr t = alloc_task_desc(sizeof(task_t));
+    t->routine = routine;
+    t->tdata = tdata;
+    t->tq = tq;
+    int count = __atomic_add_fetch(&tq->active_count, 1, __ATOMIC_RELAXED);
+    int max = tq->max_active_count;
+    while (count > max &&
+	   !__atomic_compare_exchange_n(&tq->max_active_count, &max, count, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+    if (my_worker >= 0)
+	deque_push(&deques[my_worker], t);
+    else
+	inject_push(t);
+    /* Wake a sleeping worker, if any */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&nsleeping, __ATOMIC_RELAXED) > 0) {
+	pthread_mutex_lock(&idle_mutex);
+	pthread_cond_signal(&idle_cond);
+	pthread_mutex_unlock(&idle_mutex);
+    }
+}
 
 
 
-    
+/* Join all tasks in queue.  Won't return until queue becomes empty.
+   Returns maximum number of concurrrent tasks
+*/
+int join_tasks(task_queue_ptr tq) {
+    Pthread_once(&pool_once, init_pool);
+    /* Help out rather than block, so that a worker joining subtasks
+       never leaves its core idle or deadlocks a full pool */
+    while (__atomic_load_n(&tq->active_count, __ATOMIC_ACQUIRE) > 0) {
+	task_ptr t = find_task();
+	if (t)
+	    run_task(t);
+	else
+	    sched_yield();
+    }
+    return tq->max_active_count;
+}
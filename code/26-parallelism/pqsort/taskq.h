@@ -2,45 +2,63 @@
 
 typedef void * (*thread_routine_t)(void *);
 
-/* Queue represented as singly-linked list of records */
-typedef struct TELE *task_list_ptr;
+/*
+  Tasks are run by a fixed pool of worker threads, one per core by
+  default.  Each worker owns a Chase-Lev deque: it pushes and pops
+  tasks at the bottom, while idle workers steal from the top.  Tasks
+  spawned by threads outside the pool go onto a shared injection list.
+*/
+
+/* Single task awaiting execution */
+typedef struct TASK *task_ptr;
 
-typedef struct TELE {
-  pthread_t tid;
-  task_list_ptr next;
-} task_list_t;
+typedef struct TASK {
+  thread_routine_t routine;
+  void *tdata;
+  struct TQ *tq;      /* Group this task belongs to */
+  task_ptr next;      /* Link on injection list */
+} task_t;
 
-/* All data associated with task queue encapsulated as struct */
-typedef struct {
+/* All data associated with task queue encapsulated as struct.
+   A task queue is now just a group of tasks that are joined together */
+typedef struct TQ {
   /* Number of tasks are in process */
-  int active_count;
-  int max_active_count;
-  task_list_ptr head;
-  /* Maintain pointer to tail of list for insertion */
-  task_list_ptr tail;
-  /* Mutex to protect all modifications to queue */
-  pthread_mutex_t mutex;
-#ifdef SEM
-  /* Initial binary
-     semaphore to make sure reaper only starts after first task spawned */
-  sem_t reap_ok;
-#endif
+  volatile int active_count;
+  volatile int max_active_count;
 } task_queue_t, *task_queue_ptr;
-  
+
+/* Set number of worker threads.  Default (or n <= 0) is one per online
+   processor.  May be changed between joins; extra workers sleep */
+void set_task_workers(int n);
+/* Number of worker threads in pool */
+int get_task_workers();
+/* Pin worker i to the i-th CPU (mod count) of the process's affinity
+   mask.  Call before first spawn_task */
+void set_task_affinity(int on);
+/* CPU that worker i is pinned to, or -1 if workers aren't pinned */
+int task_worker_cpu(int i);
+/* Pin the calling thread to worker i's CPU.  Returns the CPU, or -1 if
+   workers aren't pinned or pinning failed (with a warning) */
+int pin_to_worker_cpu(int i);
+
+/* Fixed-size task descriptors, one cache line each.  Drawn from a
+   per-thread free list that is refilled in chunks, keeping malloc off
+   the critical path.  Threads that free more than they allocate pass
+   the surplus back through a global pool */
+#define TASK_DESC_SIZE 64
+void *alloc_task_desc(size_t size);
+void free_task_desc(void *p);
+/* Descriptors handed out and chunk mallocs performed so far */
+void task_desc_stats(size_t *nalloc, size_t *nmalloc);
+
 task_queue_ptr new_task_queue();
 void free_task_queue(task_queue_ptr tq);
 
-/* Create a new task, spawning thread.  Return nonzero if successful */
+/* Create a new task and make it available to the worker pool */
 void spawn_task(task_queue_ptr tq, thread_routine_t routine, void *tdata);
 
 /* Join all tasks in queue.  Won't return until queue becomes empty.
+   While waiting, the caller runs queued tasks itself.
    Returns maximum number of concurrrent tasks
 */
 int join_tasks(task_queue_ptr tq);
-
-
-
-
-
-
-    
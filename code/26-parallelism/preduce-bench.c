@@ -0,0 +1,150 @@
+/* 
+ * preduce-bench.c - Compare preduce against the strategies of
+ *                   psum-mutex, psum-array and psum-local, all summing
+ *                   the same array a[i] = i.  Reports GB/s read at the
+ *                   median time, with a 95% confidence interval.
+ */
+#include "csapp.h"
+#include "preduce.h"
+#include "bench.h"
+
+/* Global shared variables for the psum-style threads */
+long *a;                    /* Array being summed */
+long nelems;
+long nthreads;
+long gsum;                  /* Shared sum for psum-mutex */
+sem_t mutex;                /* Protects gsum */
+long psum[REDUCE_MAXTHREADS]; /* Unpadded partial sums */
+
+static long start_of(long id) { return nelems * id / nthreads; }
+
+void *sum_mutex(void *vargp)
+{
+    long myid = *((long *)vargp);
+    long i;
+    for (i = start_of(myid); i < start_of(myid+1); i++) {
+	P(&mutex);
+	gsum += a[i];
+	V(&mutex);
+    }
+    return NULL;
+}
+
+void *sum_array(void *vargp)
+{
+    long myid = *((long *)vargp);
+    long i;
+    for (i = start_of(myid); i < start_of(myid+1); i++)
+	psum[myid] += a[i];
+    return NULL;
+}
+
+void *sum_local(void *vargp)
+{
+    long myid = *((long *)vargp);
+    long i, sum = 0;
+    for (i = start_of(myid); i < start_of(myid+1); i++)
+	sum += a[i];
+    psum[myid] = sum;
+    return NULL;
+}
+
+/* Spawn, join and add up partials, as the psum programs do */
+static long run_psum(void *(*routine)(void *))
+{
+    long i, myid[REDUCE_MAXTHREADS], result = 0;
+    pthread_t tid[REDUCE_MAXTHREADS];
+    gsum = 0;
+    for (i = 0; i < nthreads; i++) {
+	myid[i] = i;
+	psum[i] = 0;
+	Pthread_create(&tid[i], NULL, routine, &myid[i]);
+    }
+    for (i = 0; i < nthreads; i++)
+	Pthread_join(tid[i], NULL);
+    for (i = 0; i < nthreads; i++)
+	result += psum[i];
+    return result + gsum;
+}
+
+/* One strategy, as a benchmark closure */
+typedef struct {
+    char *name;
+    void *(*routine)(void *);   /* psum-style thread, or NULL */
+    reduce_op_t *op;            /* For preduce */
+    long expect;
+    long result;
+} strategy_t;
+
+static void run_strategy(void *arg)
+{
+    strategy_t *s = (strategy_t *) arg;
+    s->result = s->routine ? run_psum(s->routine) : preduce(a, nelems, s->op);
+}
+
+static int json = 0;
+
+/* Wall-clock time, since the threads run on every CPU.  Each psum
+   run creates its threads afresh; preduce's pool is started by the
+   warmup run */
+static void report(strategy_t *s)
+{
+    bench_closure_t b = {run_strategy, NULL, NULL, s};
+    bench_params_t p = {3, 0.02, 10, 1, BENCH_FLUSH_NONE, BENCH_CLOCK_WALL};
+    bench_result_t r;
+    double bytes = nelems * sizeof(long);
+
+    bench_run(&b, &p, &r);
+    if (json)
+	bench_print_json(stdout, s->name, &r);
+    else
+	printf("%-12s %8.3f s %8.2f GB/s  (95%% CI %.2f-%.2f)%s\n", s->name,
+	       r.median, bytes / r.median / 1e9,
+	       bytes / r.ci_hi / 1e9, bytes / r.ci_lo / 1e9,
+	       s->result == s->expect ? "" : "  (wrong result)");
+    bench_free(&r);
+    if (s->result != s->expect)
+	exit(1);
+}
+
+int main(int argc, char **argv) 
+{
+    long i, log_nelems;
+    strategy_t strategies[] = {
+	{"psum-mutex", sum_mutex, NULL},
+	{"psum-array", sum_array, NULL},
+	{"psum-local", sum_local, NULL},
+	{"preduce-sum", NULL, &reduce_sum},
+	{"preduce-max", NULL, &reduce_max},
+    };
+
+    if (argc > 1 && !strcmp(argv[1], "-j")) {
+	json = 1;
+	argv++;
+	argc--;
+    }
+    if (argc != 3) { 
+	printf("Usage: %s [-j] <nthreads> <log_nelems>\n", argv[0]);
+	printf("\t-j\tPrint each result as JSON, in seconds\n");
+	exit(0);
+    }
+    nthreads = atoi(argv[1]);
+    log_nelems = atoi(argv[2]);
+    if (nthreads < 1 || nthreads > REDUCE_MAXTHREADS || log_nelems > 34) {
+	printf("Error: invalid arguments\n");
+	exit(0);
+    }
+    nelems = 1L << log_nelems;
+    a = Malloc(nelems * sizeof(long));
+    for (i = 0; i < nelems; i++)
+	a[i] = i;
+    Sem_init(&mutex, 0, 1);
+    preduce_set_threads(nthreads);
+
+    for (i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+	strategies[i].expect = strategies[i].op == &reduce_max ?
+	    nelems-1 : (nelems * (nelems-1))/2;
+	report(&strategies[i]);
+    }
+    exit(0);
+}
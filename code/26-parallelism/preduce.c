@@ -0,0 +1,268 @@
+/* Parallel reduction over arrays */
+
+#include "preduce.h"
+#include <limits.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+/*
+ * The caller acts as thread 0.  Threads 1..nthreads-1 sleep until the
+ * job generation changes, reduce their chunk, and then join the tree:
+ * at step s = 1, 2, 4, ..., thread i with i % 2s == 0 waits for the
+ * partial of thread i+s and combines it into its own.  A thread
+ * publishes its partial by storing the job generation into its done
+ * field.  Thread 0 finishes last, holding the result.
+ */
+
+typedef struct {
+    volatile long val;
+    volatile long done;
+    char pad[REDUCE_LINE - 2*sizeof(long)];
+} partial_t;
+
+static partial_t partial[REDUCE_MAXTHREADS] __attribute__((aligned(REDUCE_LINE)));
+
+/* Current job.  Written under job_mutex */
+static const long *job_a;
+static size_t job_n;
+static reduce_op_t *job_op;
+static int job_nthreads;
+static long job_gen = 0;
+
+static int nthreads = 0;        /* Active threads, including caller */
+static int nstarted = 1;        /* Threads created, including caller */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+
+/* Which fold loops to use: 0 scalar, 1 AVX2, 2 AVX-512 */
+static int simd_level = 0;
+
+static long combine_sum(long x, long y) { return x + y; }
+static long combine_min(long x, long y) { return x < y ? x : y; }
+static long combine_max(long x, long y) { return x > y ? x : y; }
+static long combine_xor(long x, long y) { return x ^ y; }
+
+/* Fold for operators that give no fold routine.  Strictly left to
+   right, since the operator may not be commutative */
+static long fold_generic(const long *a, size_t n, long acc,
+			 long (*combine)(long, long)) {
+    size_t i;
+    for (i = 0; i < n; i++)
+	acc = combine(acc, a[i]);
+    return acc;
+}
+
+/* Fold loops for the built-in operators, which are all commutative.
+   Several accumulators, seeded with the identity, break the
+   dependence chain through acc */
+#define FOLD_SCALAR(NAME, OP, ID)					\
+static long NAME(const long *a, size_t n, long acc) {			\
+    long a0 = ID, a1 = ID, a2 = ID, a3 = ID;				\
+    size_t i;								\
+    for (i = 0; i + 4 <= n; i += 4) {					\
+	a0 = OP(a0, a[i]);						\
+	a1 = OP(a1, a[i+1]);						\
+	a2 = OP(a2, a[i+2]);						\
+	a3 = OP(a3, a[i+3]);						\
+    }									\
+    for (; i < n; i++)							\
+	a0 = OP(a0, a[i]);						\
+    return OP(acc, OP(OP(a0, a1), OP(a2, a3)));				\
+}
+
+FOLD_SCALAR(fold_sum_scalar, combine_sum, 0)
+FOLD_SCALAR(fold_min_scalar, combine_min, LONG_MAX)
+FOLD_SCALAR(fold_max_scalar, combine_max, LONG_MIN)
+FOLD_SCALAR(fold_xor_scalar, combine_xor, 0)
+
+#ifdef __x86_64__
+/* AVX2 has no 64-bit min/max: compare and blend */
+__attribute__((target("avx2")))
+static inline __m256i min_epi64_avx2(__m256i x, __m256i y) {
+    return _mm256_blendv_epi8(x, y, _mm256_cmpgt_epi64(x, y));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i max_epi64_avx2(__m256i x, __m256i y) {
+    return _mm256_blendv_epi8(y, x, _mm256_cmpgt_epi64(x, y));
+}
+
+/* Two vector accumulators of 4 lanes each */
+#define FOLD_AVX2(NAME, VOP, OP, ID)					\
+__attribute__((target("avx2")))						\
+static long NAME(const long *a, size_t n, long acc) {			\
+    __m256i v0 = _mm256_set1_epi64x(ID), v1 = v0;			\
+    long lane[4];							\
+    size_t i;								\
+    for (i = 0; i + 8 <= n; i += 8) {					\
+	v0 = VOP(v0, _mm256_loadu_si256((__m256i *) (a+i)));		\
+	v1 = VOP(v1, _mm256_loadu_si256((__m256i *) (a+i+4)));		\
+    }									\
+    _mm256_storeu_si256((__m256i *) lane, VOP(v0, v1));			\
+    for (; i < n; i++)							\
+	acc = OP(acc, a[i]);						\
+    return OP(acc, OP(OP(lane[0], lane[1]), OP(lane[2], lane[3])));	\
+}
+
+FOLD_AVX2(fold_sum_avx2, _mm256_add_epi64, combine_sum, 0)
+FOLD_AVX2(fold_min_avx2, min_epi64_avx2, combine_min, LONG_MAX)
+FOLD_AVX2(fold_max_avx2, max_epi64_avx2, combine_max, LONG_MIN)
+FOLD_AVX2(fold_xor_avx2, _mm256_xor_si256, combine_xor, 0)
+
+/* Two vector accumulators of 8 lanes each */
+#define FOLD_AVX512(NAME, VOP, OP, ID)					\
+__attribute__((target("avx512f")))					\
+static long NAME(const long *a, size_t n, long acc) {			\
+    __m512i v0 = _mm512_set1_epi64(ID), v1 = v0;			\
+    long lane[8];							\
+    size_t i;								\
+    int k;								\
+    for (i = 0; i + 16 <= n; i += 16) {					\
+	v0 = VOP(v0, _mm512_loadu_si512(a+i));				\
+	v1 = VOP(v1, _mm512_loadu_si512(a+i+8));			\
+    }									\
+    _mm512_storeu_si512(lane, VOP(v0, v1));				\
+    for (; i < n; i++)							\
+	acc = OP(acc, a[i]);						\
+    for (k = 0; k < 8; k++)						\
+	acc = OP(acc, lane[k]);						\
+    return acc;								\
+}
+
+FOLD_AVX512(fold_sum_avx512, _mm512_add_epi64, combine_sum, 0)
+FOLD_AVX512(fold_min_avx512, _mm512_min_epi64, combine_min, LONG_MAX)
+FOLD_AVX512(fold_max_avx512, _mm512_max_epi64, combine_max, LONG_MIN)
+FOLD_AVX512(fold_xor_avx512, _mm512_xor_si512, combine_xor, 0)
+
+#define FOLD_DISPATCH(NAME)						\
+static long fold_##NAME(const long *a, size_t n, long acc) {		\
+    switch (simd_level) {						\
+    case 2:								\
+	return fold_##NAME##_avx512(a, n, acc);				\
+    case 1:								\
+	return fold_##NAME##_avx2(a, n, acc);				\
+    default:								\
+	return fold_##NAME##_scalar(a, n, acc);				\
+    }									\
+}
+#else
+#define FOLD_DISPATCH(NAME)						\
+static long fold_##NAME(const long *a, size_t n, long acc) {		\
+    return fold_##NAME##_scalar(a, n, acc);				\
+}
+#endif /* __x86_64__ */
+
+FOLD_DISPATCH(sum)
+FOLD_DISPATCH(min)
+FOLD_DISPATCH(max)
+FOLD_DISPATCH(xor)
+
+reduce_op_t reduce_sum = {0, combine_sum, fold_sum};
+reduce_op_t reduce_min = {LONG_MAX, combine_min, fold_min};
+reduce_op_t reduce_max = {LONG_MIN, combine_max, fold_max};
+reduce_op_t reduce_xor = {0, combine_xor, fold_xor};
+
+/* Start of thread id's chunk, rounded to a cache line boundary so
+   that no two threads read the same line */
+static size_t chunk_start(int id, int nt) {
+    size_t per_line = REDUCE_LINE / sizeof(long);
+    size_t s = (job_n * id / nt + per_line - 1) & ~(per_line - 1);
+    return s < job_n ? s : job_n;
+}
+
+/* Reduce own chunk, then combine partials from subtree */
+static void reduce_share(int id, int nt, long gen) {
+    reduce_op_t *op = job_op;
+    size_t lo = chunk_start(id, nt);
+    size_t hi = chunk_start(id+1, nt);
+    long val = op->fold ? op->fold(job_a + lo, hi - lo, op->identity)
+	: fold_generic(job_a + lo, hi - lo, op->identity, op->combine);
+    int s;
+    for (s = 1; id % (2*s) == 0 && id + s < nt; s *= 2) {
+	partial_t *p = &partial[id+s];
+	while (__atomic_load_n(&p->done, __ATOMIC_ACQUIRE) != gen)
+	    sched_yield();
+	val = op->combine(val, p->val);
+    }
+    partial[id].val = val;
+    __atomic_store_n(&partial[id].done, gen, __ATOMIC_RELEASE);
+}
+
+static void *reduce_thread(void *vargp) {
+    int id = (long) vargp;
+    long gen = 0;
+    while (1) {
+	pthread_mutex_lock(&job_mutex);
+	while (job_gen == gen)
+	    pthread_cond_wait(&job_cond, &job_mutex);
+	gen = job_gen;
+	int nt = job_nthreads;
+	pthread_mutex_unlock(&job_mutex);
+	if (id < nt)
+	    reduce_share(id, nt, gen);
+    }
+    return NULL;
+}
+
+/* Make n threads active, creating them as needed.  Caller holds
+   pool_mutex */
+static void resize_pool(int n) {
+    long i;
+    pthread_t tid;
+    if (n <= 0)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > REDUCE_MAXTHREADS)
+	n = REDUCE_MAXTHREADS;
+    if (nthreads == 0) {
+#ifdef __x86_64__
+	if (__builtin_cpu_supports("avx512f"))
+	    simd_level = 2;
+	else if (__builtin_cpu_supports("avx2"))
+	    simd_level = 1;
+#endif
+    }
+    for (i = nstarted; i < n; i++) {
+	Pthread_create(&tid, NULL, reduce_thread, (void *) i);
+	Pthread_detach(tid);
+    }
+    if (n > nstarted)
+	nstarted = n;
+    nthreads = n;
+}
+
+void preduce_set_threads(int n) {
+    pthread_mutex_lock(&pool_mutex);
+    resize_pool(n);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+int preduce_get_threads() {
+    pthread_mutex_lock(&pool_mutex);
+    if (nthreads == 0)
+	resize_pool(0);
+    int n = nthreads;
+    pthread_mutex_unlock(&pool_mutex);
+    return n;
+}
+
+long preduce(const long *a, size_t n, reduce_op_t *op) {
+    /* One reduction at a time */
+    pthread_mutex_lock(&pool_mutex);
+    if (nthreads == 0)
+	resize_pool(0);
+    pthread_mutex_lock(&job_mutex);
+    job_a = a;
+    job_n = n;
+    job_op = op;
+    job_nthreads = nthreads;
+    long gen = ++job_gen;
+    if (nthreads > 1)
+	pthread_cond_broadcast(&job_cond);
+    pthread_mutex_unlock(&job_mutex);
+    reduce_share(0, nthreads, gen);
+    long result = partial[0].val;
+    pthread_mutex_unlock(&pool_mutex);
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef __PREDUCE_H__
+#define __PREDUCE_H__
+
+#include "csapp.h"
+
+/*
+ * Parallel reduction of an array of longs with an associative
+ * operator.  The array is split into one contiguous chunk per thread
+ * of a persistent pool.  Each thread folds its chunk into a partial
+ * result in its own cache line, and the partials are then combined
+ * pairwise up a binary tree.  Partials are always combined left to
+ * right, so the operator need not be commutative.
+ */
+
+/* $begin reduceop */
+typedef struct {
+    long identity;                   /* combine(identity, x) == x */
+    long (*combine)(long x, long y); /* Must be associative */
+    /* Optional: fold a[0..n-1] into acc.  NULL means call combine
+       once per element */
+    long (*fold)(const long *a, size_t n, long acc);
+} reduce_op_t;
+/* $end reduceop */
+
+/* Built-in operators, with SIMD fold loops where the CPU has them */
+extern reduce_op_t reduce_sum;
+extern reduce_op_t reduce_min;
+extern reduce_op_t reduce_max;
+extern reduce_op_t reduce_xor;
+
+/* Size of a cache line; every partial is padded out to this */
+#define REDUCE_LINE 64
+/* Largest number of threads in the pool */
+#define REDUCE_MAXTHREADS 256
+
+/* Set number of threads, including the caller.  Default (or n <= 0)
+   is one per online processor.  May be changed between reductions */
+void preduce_set_threads(int n);
+int preduce_get_threads();
+
+/* Reduce a[0..n-1].  Returns op->identity when n == 0 */
+long preduce(const long *a, size_t n, reduce_op_t *op);
+
+#endif /* __PREDUCE_H__ */
@@ -0,0 +1,260 @@
+/* Generic benchmark runner, shared by the fcyc variants and drivers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "clock.h"
+#include "bench.h"
+
+/* k smallest samples so far, in increasing order */
+static double *values = NULL;
+/* All samples, in order taken */
+static double *samples = NULL;
+static int samplecount = 0;
+static int kbest = 0;
+
+/* Start new sampling process */
+static void init_sampler(int k, int maxsamples)
+{
+  free(values);
+  values = calloc(k, sizeof(double));
+  free(samples);
+  samples = calloc(maxsamples, sizeof(double));
+  samplecount = 0;
+  kbest = k;
+}
+
+/* Add new sample.  */
+static void add_sample(double val)
+{
+  int k = kbest;
+  int pos = 0;
+  if (samplecount < k) {
+    pos = samplecount;
+    values[pos] = val;
+  } else if (val < values[k-1]) {
+    pos = k-1;
+    values[pos] = val;
+  }
+  samples[samplecount] = val;
+  samplecount++;
+  /* Insertion sort */
+  while (pos > 0 && values[pos-1] > values[pos]) {
+    double temp = values[pos-1];
+    values[pos-1] = values[pos];
+    values[pos] = temp;
+    pos--;
+  }
+}
+
+/* Get current minimum */
+double get_min()
+{
+  return values[0];
+}
+
+/* What is relative error for kth smallest sample */
+double err(int k)
+{
+  if (samplecount < k)
+    return 1000.0;
+  return (values[k-1] - values[0])/values[0];
+}
+
+/* Have k minimum measurements converged within epsilon? */
+int has_converged(int k_arg, double epsilon_arg, int maxsamples)
+{
+  if ((samplecount >= k_arg) &&
+      ((1 + epsilon_arg)*values[0] >= values[k_arg-1]))
+    return samplecount;
+  if ((samplecount >= maxsamples))
+    return -1;
+  return 0;
+}
+
+/* Code to clear cache: sweep a buffer twice the size of the cache,
+   one access per line */
+#define LINE 64
+static char *flush_buf = NULL;
+static long flush_size = 0;
+static volatile long sink;
+
+static void flush(bench_flush_t policy)
+{
+  long size, i, x = 0;
+  if (policy == BENCH_FLUSH_NONE)
+    return;
+  size = sysconf(policy == BENCH_FLUSH_L2 ?
+		 _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+  if (size <= 0)
+    size = policy == BENCH_FLUSH_L2 ? (1 << 20) : (32 << 20);
+  size *= 2;
+  if (size > flush_size) {
+    free(flush_buf);
+    flush_buf = calloc(size, 1);
+    flush_size = size;
+  }
+  for (i = 0; i < size; i += LINE) {
+    x += flush_buf[i];
+    flush_buf[i] = x;
+  }
+  sink = x;
+}
+
+/* System clock, as cycles */
+static double tod_start;
+
+/* Can BENCH_CLOCK_CORE count core cycles?  Warns once if not */
+static int core_available()
+{
+  static int avail = -1;
+  if (avail < 0) {
+    avail = pc_available(PC_CYCLES);
+    if (!avail)
+      fprintf(stderr, "Warning: core cycle counter unavailable.  "
+	      "Using TSC cycles, which tick at the nominal clock rate\n");
+  }
+  return avail;
+}
+
+static void start_clock(bench_clock_t clock)
+{
+  switch (clock) {
+  case BENCH_CLOCK_COMP:
+    start_comp_counter();
+    break;
+  case BENCH_CLOCK_TOD:
+    mhz(0);
+    tod_start = time_now();
+    break;
+  case BENCH_CLOCK_WALL:
+    tod_start = time_now();
+    break;
+  case BENCH_CLOCK_CORE:
+    if (core_available())
+      pc_start();
+    else
+      start_counter();
+    break;
+  default:
+    start_counter();
+  }
+}
+
+static double read_clock(bench_clock_t clock)
+{
+  switch (clock) {
+  case BENCH_CLOCK_COMP:
+    return get_comp_counter();
+  case BENCH_CLOCK_TOD:
+    return (time_now() - tod_start) * 1e6 * mhz(0);
+  case BENCH_CLOCK_WALL:
+    return time_now() - tod_start;
+  case BENCH_CLOCK_CORE:
+    if (core_available()) {
+      long long counts[PC_NEVENT];
+      pc_read(counts);
+      return (double) counts[PC_CYCLES];
+    }
+    return get_counter();
+  default:
+    return get_counter();
+  }
+}
+
+static int comp_double(const void *p1, const void *p2)
+{
+  double x1 = *(double *) p1;
+  double x2 = *(double *) p2;
+  return (x1 > x2) - (x1 < x2);
+}
+
+/* Two-sided 97.5% points of Student's t for 1..30 degrees of freedom */
+static double t975[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static void summarize(bench_result_t *r, int k, double epsilon)
+{
+  int n = samplecount, i;
+  double sum = 0.0, ss = 0.0;
+  double *sorted = malloc(n * sizeof(double));
+
+  r->nsamples = n;
+  r->converged = (n >= k) && ((1 + epsilon)*values[0] >= values[k-1]);
+  r->samples = malloc(n * sizeof(double));
+  memcpy(r->samples, samples, n * sizeof(double));
+  memcpy(sorted, samples, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), comp_double);
+  r->min = sorted[0];
+  r->median = (n % 2) ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+  for (i = 0; i < n; i++)
+    sum += sorted[i];
+  r->mean = sum / n;
+  for (i = 0; i < n; i++)
+    ss += (sorted[i] - r->mean) * (sorted[i] - r->mean);
+  r->stddev = n > 1 ? sqrt(ss / (n-1)) : 0.0;
+  double t = n > 31 ? 1.960 : (n > 1 ? t975[n-2] : 0.0);
+  r->ci_lo = r->mean - t * r->stddev / sqrt(n);
+  r->ci_hi = r->mean + t * r->stddev / sqrt(n);
+  free(sorted);
+}
+
+void bench_run(bench_closure_t *b, bench_params_t *p, bench_result_t *r)
+{
+  int i;
+  init_sampler(p->k, p->maxsamples);
+  for (i = 0; i < p->warmup; i++) {
+    if (b->setup)
+      b->setup(b->arg);
+    b->run(b->arg);
+    if (b->teardown)
+      b->teardown(b->arg);
+  }
+  do {
+    double cyc;
+    flush(p->flush);
+    if (b->setup)
+      b->setup(b->arg);
+    start_clock(p->clock);
+    b->run(b->arg);
+    cyc = read_clock(p->clock);
+    if (b->teardown)
+      b->teardown(b->arg);
+    add_sample(cyc);
+  } while (!has_converged(p->k, p->epsilon, p->maxsamples) &&
+	   samplecount < p->maxsamples);
+#ifdef DEBUG
+  {
+    int i;
+    printf(" %d smallest values: [", p->k);
+    for (i = 0; i < p->k; i++)
+      printf("%.0f%s", values[i], i==p->k-1 ? "]\n" : ", ");
+  }
+#endif
+  summarize(r, p->k, p->epsilon);
+}
+
+void bench_free(bench_result_t *r)
+{
+  free(r->samples);
+  r->samples = NULL;
+}
+
+void bench_print_json(FILE *fp, const char *name, bench_result_t *r)
+{
+  int i;
+  /* %.9g: whole cycle counts, or seconds to the nanosecond */
+  fprintf(fp, "{\"name\": \"%s\", \"nsamples\": %d, \"converged\": %s, "
+	  "\"min\": %.9g, \"median\": %.9g, \"mean\": %.9g, \"stddev\": %.9g, "
+	  "\"ci95\": [%.9g, %.9g], \"samples\": [",
+	  name, r->nsamples, r->converged ? "true" : "false",
+	  r->min, r->median, r->mean, r->stddev, r->ci_lo, r->ci_hi);
+  for (i = 0; i < r->nsamples; i++)
+    fprintf(fp, "%s%.9g", i ? ", " : "", r->samples[i]);
+  fprintf(fp, "]}\n");
+}
@@ -0,0 +1,81 @@
+/* Generic benchmark runner */
+#include <stdio.h>
+
+/*
+ * Times a closure repeatedly with the K-best scheme: sample until the
+ * k smallest samples are within a factor 1+epsilon of each other, or
+ * until maxsamples.  Setup and teardown run outside the timed region
+ * of every sample.  The cache can be flushed before each sample, and
+ * untimed warmup runs can precede sampling.
+ */
+
+typedef void (*bench_fn_t)(void *arg);
+
+typedef struct {
+  bench_fn_t run;          /* Code being timed */
+  bench_fn_t setup;        /* Before each sample, untimed (or NULL) */
+  bench_fn_t teardown;     /* After each sample, untimed (or NULL) */
+  void *arg;               /* Passed to all three */
+} bench_closure_t;
+
+typedef enum {
+  BENCH_FLUSH_NONE,        /* Leave caches alone */
+  BENCH_FLUSH_L2,          /* Sweep a buffer twice the size of L2 */
+  BENCH_FLUSH_LLC          /* Sweep a buffer twice the size of last level */
+} bench_flush_t;
+
+typedef enum {
+  BENCH_CLOCK_CYCLES,      /* Cycle counter (clock.h) */
+  BENCH_CLOCK_COMP,        /* Cycle counter less timer interrupt time */
+  BENCH_CLOCK_TOD,         /* System clock, converted to cycles */
+  BENCH_CLOCK_WALL,        /* System clock, in seconds.  Unlike the
+			      others, doesn't pin the calling thread, so
+			      threads it creates can use every CPU */
+  BENCH_CLOCK_CORE         /* Core clock cycles (PC_CYCLES) where the
+			      kernel allows, else the cycle counter,
+			      with a warning */
+} bench_clock_t;
+
+typedef struct {
+  int k;                   /* Converge when k smallest samples ... */
+  double epsilon;          /* ... are within this relative tolerance */
+  int maxsamples;          /* Give up after this many */
+  int warmup;              /* Untimed runs before sampling */
+  bench_flush_t flush;
+  bench_clock_t clock;
+} bench_params_t;
+
+#define BENCH_DEFAULT_PARAMS \
+  {3, 0.01, 20, 0, BENCH_FLUSH_NONE, BENCH_CLOCK_CYCLES}
+
+typedef struct {
+  int nsamples;
+  int converged;           /* 1 if the k best samples converged */
+  double min;              /* Cycles (BENCH_CLOCK_WALL: seconds) */
+  double median;
+  double mean;
+  double stddev;
+  double ci_lo, ci_hi;     /* 95% confidence interval for the mean */
+  double *samples;         /* All nsamples, in order taken */
+} bench_result_t;
+
+/* Run benchmark.  Free result with bench_free */
+void bench_run(bench_closure_t *b, bench_params_t *p, bench_result_t *r);
+void bench_free(bench_result_t *r);
+
+/* Write result as one JSON object, tagged with name */
+void bench_print_json(FILE *fp, const char *name, bench_result_t *r);
+
+/** State of the sampler during or after the most recent run */
+
+/* Get current minimum */
+double get_min();
+
+/* What is convergence status for k minimum measurements within epsilon
+   Returns 0 if not converged, #samples if converged, and -1 if can't
+   reach convergence
+*/
+int has_converged(int k, double epsilon, int maxsamples);
+
+/* What is error of current measurement */
+double err(int k);
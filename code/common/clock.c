@@ -0,0 +1,282 @@
+/* Needs _GNU_SOURCE for CPU affinity */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/times.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "clock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_TSC 1
+#endif
+
+/* Keep track of most recent reading of cycle counter */
+static unsigned long long cyc_start = 0;
+
+/* Counter rate, in ticks per second */
+static double tsc_rate = 0.0;
+
+double time_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+#ifdef HAVE_TSC
+/* lfence waits for earlier instructions to complete */
+unsigned long long tsc_begin()
+{
+  unsigned hi, lo;
+  asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+  return ((unsigned long long) hi << 32) | lo;
+}
+
+/* rdtscp waits for earlier instructions; lfence keeps later ones
+   from starting */
+unsigned long long tsc_end()
+{
+  unsigned hi, lo, aux;
+  asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+  return ((unsigned long long) hi << 32) | lo;
+}
+
+int tsc_invariant()
+{
+  unsigned a, b, c, d;
+  asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000000));
+  if (a < 0x80000007)
+    return 0;
+  asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000007));
+  return (d >> 8) & 1;
+}
+#else
+/* No TSC: count nanoseconds */
+unsigned long long tsc_begin()
+{
+  return (unsigned long long) (time_now() * 1e9);
+}
+
+unsigned long long tsc_end()
+{
+  return tsc_begin();
+}
+
+int tsc_invariant()
+{
+  return 1;
+}
+#endif /* HAVE_TSC */
+
+int pin_cpu(int cpu)
+{
+  cpu_set_t set;
+  if (cpu < 0)
+    cpu = sched_getcpu();
+  if (cpu < 0)
+    return -1;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    return -1;
+  return cpu;
+}
+
+/* Spin for about secs seconds, measuring TSC rate */
+static double measure_rate(double secs)
+{
+  double t0 = time_now(), t1;
+  unsigned long long c0 = tsc_begin(), c1;
+  do {
+    t1 = time_now();
+    c1 = tsc_end();
+  } while (t1 - t0 < secs);
+  return (c1 - c0) / (t1 - t0);
+}
+
+/* One-time setup for counter use: pin and calibrate */
+static void init_counter()
+{
+  if (tsc_rate > 0.0)
+    return;
+  pin_cpu(-1);
+  if (!tsc_invariant())
+    fprintf(stderr, "Warning: TSC not invariant.  Counts may not track time\n");
+  /* Best of a few short calibrations */
+  double r1 = measure_rate(0.02), r2 = measure_rate(0.02), r3 = measure_rate(0.02);
+  double lo = r1 < r2 ? r1 : r2;
+  double hi = r1 < r2 ? r2 : r1;
+  /* Median */
+  tsc_rate = r3 < lo ? lo : (r3 > hi ? hi : r3);
+}
+
+void start_counter()
+{
+  init_counter();
+  cyc_start = tsc_begin();
+}
+
+double get_counter()
+{
+  unsigned long long now = tsc_end();
+  double result = (double) (now - cyc_start);
+  if (now < cyc_start) {
+    fprintf(stderr, "Error: Cycle counter returning negative value: %.0f\n",
+	    -(double) (cyc_start - now));
+  }
+  return result;
+}
+
+double ovhd()
+{
+  /* Do it twice to eliminate cache effects */
+  int i;
+  double result;
+  for (i = 0; i < 2; i++) {
+    start_counter();
+    result = get_counter();
+  }
+  return result;
+}
+
+double mhz(int verbose)
+{
+  init_counter();
+  if (verbose)
+    printf("Processor Clock Rate ~= %.1f MHz (TSC, calibrated)\n", tsc_rate / 1e6);
+  return tsc_rate / 1e6;
+}
+
+/* Calibrate over sleeptime seconds.  Spins rather than sleeps, since
+   the counter may stop in deep sleep states */
+double mhz_full(int verbose, int sleeptime)
+{
+  init_counter();
+  tsc_rate = measure_rate(sleeptime);
+  return mhz(verbose);
+}
+
+/** Special counters that compensate for timer interrupt overhead */
+
+static double cyc_per_tick = 0.0;
+
+#define NEVENT 100
+#define THRESHOLD 1000
+#define RECORDTHRESH 3000
+
+/* Attempt to see how much time is used by timer interrupt */
+static void callibrate(int verbose)
+{
+  double oldt;
+  struct tms t;
+  clock_t oldc;
+  int e = 0;
+  times(&t);
+  oldc = t.tms_utime;
+  start_counter();
+  oldt = get_counter();
+  while (e <NEVENT) {
+    double newt = get_counter();
+    if (newt-oldt >= THRESHOLD) {
+      clock_t newc;
+      times(&t);
+      newc = t.tms_utime;
+      if (newc > oldc) {
+	double cpt = (newt-oldt)/(newc-oldc);
+	if ((cyc_per_tick == 0.0 || cyc_per_tick > cpt) && cpt > RECORDTHRESH)
+	  cyc_per_tick = cpt;
+	e++;
+	oldc = newc;
+      }
+      oldt = newt;
+    }
+  }
+  if (verbose)
+    printf("Setting cyc_per_tick to %f\n", cyc_per_tick);
+}
+
+static clock_t start_tick = 0;
+
+void start_comp_counter() {
+  struct tms t;
+  if (cyc_per_tick == 0.0)
+    callibrate(1);
+  times(&t);
+  start_tick = t.tms_utime;
+  start_counter();
+}
+
+double get_comp_counter() {
+  double time = get_counter();
+  double ctime;
+  struct tms t;
+  clock_t ticks;
+  times(&t);
+  ticks = t.tms_utime - start_tick;
+  ctime = time - ticks*cyc_per_tick;
+  return ctime;
+}
+
+/** Hardware event counters */
+
+static int pc_fd[PC_NEVENT];
+static long long pc_base[PC_NEVENT];
+static int pc_opened = 0;
+
+static int perf_open(unsigned type, unsigned long long config)
+{
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = type;
+  pe.size = sizeof(pe);
+  pe.config = config;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static void pc_open()
+{
+  if (pc_opened)
+    return;
+  pc_opened = 1;
+  pc_fd[PC_CYCLES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  pc_fd[PC_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  pc_fd[PC_CACHE_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+static long long pc_value(int e)
+{
+  long long v;
+  if (pc_fd[e] < 0 || read(pc_fd[e], &v, sizeof(v)) != sizeof(v))
+    return -1;
+  return v;
+}
+
+int pc_available(int event)
+{
+  pc_open();
+  return event >= 0 && event < PC_NEVENT && pc_fd[event] >= 0;
+}
+
+void pc_start()
+{
+  int e;
+  pc_open();
+  for (e = 0; e < PC_NEVENT; e++)
+    pc_base[e] = pc_value(e);
+}
+
+void pc_read(long long counts[PC_NEVENT])
+{
+  int e;
+  for (e = 0; e < PC_NEVENT; e++) {
+    long long v = pc_value(e);
+    counts[e] = (v < 0 || pc_base[e] < 0) ? -1 : v - pc_base[e];
+  }
+}
@@ -0,0 +1,68 @@
+/* Routines for using cycle counter */
+
+/*
+ * The counter is the time-stamp counter (TSC), read with serializing
+ * fences so that the timed code can neither start before
+ * start_counter() nor finish after get_counter().  On current x86
+ * CPUs the TSC ticks at a constant rate whatever the core clock does
+ * (invariant TSC), so counts are proportional to time.  Its rate is
+ * calibrated against CLOCK_MONOTONIC_RAW rather than read from
+ * /proc/cpuinfo or estimated by sleeping.  The first use of the
+ * counter pins the calling thread to the CPU it is running on, so
+ * all readings come from one core.
+ */
+
+/* Start the counter */
+void start_counter();
+
+/* Get # cycles since counter started */
+double get_counter();
+
+
+/* Measure overhead for counter */
+double ovhd();
+
+/* Determine clock rate of processor */
+double mhz(int verbose);
+
+/* Determine clock rate of processor, having more control over accuracy */
+double mhz_full(int verbose, int sleeptime);
+
+/** Special counters that compensate for timer interrupt overhead */
+
+void start_comp_counter();
+
+double get_comp_counter();
+
+/** Lower-level interface */
+
+/* Serialized TSC reads: use tsc_begin() before and tsc_end() after
+   the code being timed */
+unsigned long long tsc_begin();
+unsigned long long tsc_end();
+
+/* Does the TSC tick at a constant rate across frequency changes
+   and sleep states? */
+int tsc_invariant();
+
+/* Seconds on CLOCK_MONOTONIC_RAW.  Does not pin */
+double time_now();
+
+/* Pin calling thread to cpu (< 0: the one it is on now).  Returns
+   the CPU, or -1 on failure */
+int pin_cpu(int cpu);
+
+/* Hardware event counts via perf_event_open, where the kernel allows */
+#define PC_CYCLES 0         /* Core clock cycles */
+#define PC_INSTRUCTIONS 1   /* Instructions retired */
+#define PC_CACHE_MISSES 2   /* Last-level cache misses */
+#define PC_NEVENT 3
+
+/* Is event available? */
+int pc_available(int event);
+
+/* Start counting events for calling thread */
+void pc_start();
+
+/* Counts since pc_start.  -1 for unavailable events */
+void pc_read(long long counts[PC_NEVENT]);